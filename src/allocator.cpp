@@ -0,0 +1,189 @@
+#include "allocator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+constexpr auto class_count = allocator::size_classes.size();
+constexpr auto slab_size = std::size_t{64 * 1024};
+// blocks moved between a thread cache and the central list at once.
+constexpr auto batch_size = std::size_t{64};
+// luau only requires LUAI_USER_ALIGNMENT_T alignment, which is 8 bytes.
+static_assert(allocator::size_classes.front() >= sizeof(void*));
+
+constexpr auto class_lookup = [] {
+    auto lookup = std::array<std::uint8_t, allocator::max_pooled / 8 + 1>{};
+    auto cls = std::size_t{};
+    for (std::size_t i{}; i < lookup.size(); ++i) {
+        while (allocator::size_classes[cls] < i * 8) ++cls;
+        lookup[i] = static_cast<std::uint8_t>(cls);
+    }
+    return lookup;
+}();
+constexpr auto class_of(std::size_t size) -> std::size_t {
+    return class_lookup[(size + 7) / 8];
+}
+static_assert(allocator::size_classes[class_of(1)] == 8);
+static_assert(allocator::size_classes[class_of(65)] == 80);
+static_assert(allocator::size_classes[class_of(512)] == 512);
+
+struct block {
+    block* next;
+};
+struct free_list {
+    block* head = nullptr;
+    std::size_t count = 0;
+    void push(block* b) {
+        b->next = head;
+        head = b;
+        ++count;
+    }
+    auto pop() -> block* {
+        auto b = head;
+        head = b->next;
+        --count;
+        return b;
+    }
+};
+struct central_list {
+    std::mutex mutex;
+    free_list blocks;
+};
+struct central_heap {
+    std::array<central_list, class_count> lists;
+    std::mutex slab_mutex;
+    std::vector<void*> slabs;
+    std::atomic<std::size_t> reserved{};
+    ~central_heap() {
+        for (auto slab : slabs) std::free(slab);
+    }
+};
+auto central() -> central_heap& {
+    static auto heap = central_heap{};
+    return heap;
+}
+// carves a fresh slab into blocks of the given class.
+void grow(std::size_t cls, free_list& into) {
+    auto const size = allocator::size_classes[cls];
+    auto slab = static_cast<std::byte*>(std::malloc(slab_size));
+    if (not slab) return;
+    auto& c = central();
+    {
+        auto lock = std::scoped_lock{c.slab_mutex};
+        c.slabs.push_back(slab);
+    }
+    c.reserved.fetch_add(slab_size, std::memory_order_relaxed);
+    for (auto offset = slab_size - slab_size % size; offset >= size; offset -= size) {
+        into.push(reinterpret_cast<block*>(slab + offset - size));
+    }
+}
+struct thread_cache {
+    std::array<free_list, class_count> lists;
+    ~thread_cache() {
+        for (std::size_t cls{}; cls < class_count; ++cls) release(cls, lists[cls].count);
+    }
+    void refill(std::size_t cls) {
+        auto& local = lists[cls];
+        auto& shared = central().lists[cls];
+        {
+            auto lock = std::scoped_lock{shared.mutex};
+            for (std::size_t i{}; i < batch_size and shared.blocks.head; ++i) {
+                local.push(shared.blocks.pop());
+            }
+        }
+        if (not local.head) grow(cls, local);
+    }
+    void release(std::size_t cls, std::size_t amount) {
+        auto& local = lists[cls];
+        auto& shared = central().lists[cls];
+        auto lock = std::scoped_lock{shared.mutex};
+        for (std::size_t i{}; i < amount and local.head; ++i) {
+            shared.blocks.push(local.pop());
+        }
+    }
+    auto take(std::size_t cls) -> void* {
+        auto& local = lists[cls];
+        if (not local.head) refill(cls);
+        if (not local.head) return nullptr;
+        return local.pop();
+    }
+    void give(std::size_t cls, void* ptr) {
+        auto& local = lists[cls];
+        local.push(static_cast<block*>(ptr));
+        // keeps blocks freed by one thread available to the others.
+        if (local.count > batch_size * 2) release(cls, batch_size);
+    }
+};
+thread_local auto cache = thread_cache{};
+
+void track(allocator::heap& h, std::size_t osize, std::size_t nsize, bool pooled_old, bool pooled_new) {
+    (pooled_old ? h.pooled_bytes : h.large_bytes) -= osize;
+    (pooled_new ? h.pooled_bytes : h.large_bytes) += nsize;
+    if (nsize > osize) h.allocated_bytes += nsize - osize;
+    h.peak_bytes = std::max(h.peak_bytes, h.bytes());
+}
+}
+
+auto allocator::allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize) -> void* {
+    auto& h = *static_cast<heap*>(ud);
+    if (not ptr) osize = 0;
+    auto const pooled_old = osize > 0 and osize <= max_pooled;
+    auto const pooled_new = nsize > 0 and nsize <= max_pooled;
+    if (nsize == 0) {
+        if (pooled_old) cache.give(class_of(osize), ptr);
+        else std::free(ptr);
+        ++h.frees;
+        track(h, osize, 0, pooled_old, false);
+        return nullptr;
+    }
+    if (pooled_old and pooled_new and class_of(osize) == class_of(nsize)) {
+        track(h, osize, nsize, true, true);
+        return ptr;
+    }
+    void* result = nullptr;
+    if (pooled_new) {
+        result = cache.take(class_of(nsize));
+        if (not result) return nullptr;
+        if (ptr) std::memcpy(result, ptr, std::min(osize, nsize));
+        if (pooled_old) cache.give(class_of(osize), ptr);
+        else std::free(ptr);
+    } else if (pooled_old) {
+        result = std::malloc(nsize);
+        if (not result) return nullptr;
+        std::memcpy(result, ptr, std::min(osize, nsize));
+        cache.give(class_of(osize), ptr);
+    } else {
+        result = std::realloc(ptr, nsize);
+        if (not result) return nullptr;
+    }
+    if (not ptr) ++h.allocations;
+    track(h, osize, nsize, pooled_old, pooled_new);
+    return result;
+}
+auto allocator::allocate_system(void* ud, void* ptr, std::size_t osize, std::size_t nsize) -> void* {
+    auto& h = *static_cast<heap*>(ud);
+    if (not ptr) osize = 0;
+    if (nsize == 0) {
+        std::free(ptr);
+        ++h.frees;
+        track(h, osize, 0, false, false);
+        return nullptr;
+    }
+    auto result = std::realloc(ptr, nsize);
+    if (not result) return nullptr;
+    if (not ptr) ++h.allocations;
+    track(h, osize, nsize, false, false);
+    return result;
+}
+auto allocator::stats() -> process_stats {
+    auto& c = central();
+    auto lock = std::scoped_lock{c.slab_mutex};
+    return {
+        .reserved_bytes = c.reserved.load(std::memory_order_relaxed),
+        .slabs = c.slabs.size(),
+    };
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <lua.h>
+
+// size class pool allocator for lua states. requests up to max_pooled bytes
+// are served from per size class free lists: a thread local cache in front
+// of a process wide central list, refilled from slabs that are retained
+// until exit. larger requests go to the system allocator.
+namespace allocator {
+constexpr auto size_classes = std::to_array<std::size_t>({
+    8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+});
+constexpr auto max_pooled = size_classes.back();
+
+// byte counters of a single state, passed as the allocator userdata.
+// only touched by the thread currently running the state.
+struct heap {
+    std::size_t pooled_bytes{};
+    std::size_t large_bytes{};
+    std::size_t peak_bytes{};
+    std::uint64_t allocations{};
+    std::uint64_t frees{};
+    // cumulative, includes growth through reallocation.
+    std::uint64_t allocated_bytes{};
+    auto bytes() const -> std::size_t {return pooled_bytes + large_bytes;}
+};
+struct process_stats {
+    std::size_t reserved_bytes;
+    std::size_t slabs;
+};
+// lua_Alloc compatible, ud must point to a heap.
+auto allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize) -> void*;
+// lua_Alloc compatible system allocator that still fills the heap counters.
+auto allocate_system(void* ud, void* ptr, std::size_t osize, std::size_t nsize) -> void*;
+auto stats() -> process_stats;
+}
@@ -0,0 +1,326 @@
+#include "bundle.hpp"
+#include "resolve.hpp"
+#include "export.hpp"
+#include "bytecode_cache.hpp"
+#include <lualib.h>
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <print>
+#include <string_view>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+namespace fs = std::filesystem;
+namespace rgs = std::ranges;
+using bundle::image;
+
+// [executable][bytecode of every module][index][footer]
+namespace {
+constexpr auto footer_magic = std::string_view{"WOWBNDL1"};
+constexpr std::uint32_t format_version = 1;
+// registry table of module results by index, false while a module loads.
+constexpr auto cache_key = "_BUNDLED";
+struct footer {
+    std::uint64_t blobs_offset;
+    std::uint64_t index_offset;
+    std::uint64_t index_size;
+    char magic[8];
+};
+struct index_writer {
+    std::string out;
+    template <typename T>
+    void put(T v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+    void put(std::string_view s) {
+        put(static_cast<std::uint32_t>(s.size()));
+        out.append(s);
+    }
+};
+struct index_reader {
+    std::span<const char> in;
+    bool failed = false;
+    template <typename T>
+    auto take() -> T {
+        auto v = T{};
+        if (in.size() < sizeof(T)) {
+            failed = true;
+            return v;
+        }
+        std::memcpy(&v, in.data(), sizeof(T));
+        in = in.subspan(sizeof(T));
+        return v;
+    }
+    auto take_string() -> std::string {
+        auto const size = take<std::uint32_t>();
+        if (in.size() < size) {
+            failed = true;
+            return {};
+        }
+        auto s = std::string{in.data(), size};
+        in = in.subspan(size);
+        return s;
+    }
+};
+auto executable_path() -> fs::path {
+#ifdef _WIN32
+    auto buffer = std::wstring(32'768, L'\0');
+    buffer.resize(GetModuleFileNameW(nullptr, buffer.data(), static_cast<DWORD>(buffer.size())));
+    return buffer;
+#else
+    auto ec = std::error_code{};
+    return fs::read_symlink("/proc/self/exe", ec);
+#endif
+}
+auto read_footer(fs::path const& path) -> std::optional<footer> {
+    auto file = std::ifstream{path, std::ios::binary | std::ios::ate};
+    if (not file or static_cast<std::size_t>(file.tellg()) < sizeof(footer)) return std::nullopt;
+    auto f = footer{};
+    file.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+    if (not file.read(reinterpret_cast<char*>(&f), sizeof(f))) return std::nullopt;
+    if (std::string_view{f.magic, sizeof(f.magic)} != footer_magic) return std::nullopt;
+    return f;
+}
+// the executable stays mapped for the lifetime of the process, module
+// bytecode is loaded straight from the mapping.
+auto map_executable(fs::path const& path) -> std::span<const char> {
+#ifdef _WIN32
+    static auto const contents = read_file(path).value_or(std::string{});
+    return contents;
+#else
+    auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return {};
+    struct stat info{};
+    auto mapped = MAP_FAILED;
+    if (::fstat(fd, &info) == 0) mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return {};
+    return {static_cast<const char*>(mapped), static_cast<std::size_t>(info.st_size)};
+#endif
+}
+auto open_image() -> std::optional<image> {
+    auto const path = executable_path();
+    auto const f = read_footer(path);
+    if (not f) return std::nullopt;
+    auto const mapped = map_executable(path);
+    if (mapped.size() < f->index_offset + f->index_size) return std::nullopt;
+    auto const blobs = mapped.subspan(f->blobs_offset);
+    auto reader = index_reader{mapped.subspan(f->index_offset, f->index_size)};
+    if (reader.take<std::uint32_t>() != format_version) return std::nullopt;
+    auto bundle = image{};
+    bundle.modules.resize(reader.take<std::uint32_t>());
+    for (std::uint32_t i{}; i < bundle.modules.size() and not reader.failed; ++i) {
+        auto& m = bundle.modules[i];
+        m.chunkname = reader.take_string();
+        auto const offset = reader.take<std::uint64_t>();
+        auto const size = reader.take<std::uint64_t>();
+        if (offset + size > blobs.size()) return std::nullopt;
+        m.bytecode = blobs.subspan(offset, size);
+        auto const count = reader.take<std::uint32_t>();
+        for (std::uint32_t r{}; r < count and not reader.failed; ++r) {
+            auto request = reader.take_string();
+            m.dependencies.emplace(std::move(request), reader.take<std::uint32_t>());
+        }
+        bundle.by_chunkname.emplace(m.chunkname, i);
+    }
+    if (reader.failed or bundle.modules.empty()) return std::nullopt;
+    return bundle;
+}
+// runs the module in its own sandboxed thread like the require loader and
+// leaves its result on the stack, or an error message and false.
+auto run_module(lua_State* L, bundle::module const& m) -> bool {
+    auto GL = lua_mainthread(L);
+    auto ML = lua_newthread(GL);
+    lua_xmove(GL, L, 1);
+    luaL_sandboxthread(ML);
+    set_memory_category(ML, memory_category::modules);
+    auto loaded = lua::load(ML, m.bytecode, {
+        .codegen = active_build_settings().codegen,
+        .chunkname = m.chunkname,
+        .userdata_types = userdata_types::names(),
+    });
+    auto ok = false;
+    if (not loaded) {
+        lua::push(ML, loaded.error());
+    } else {
+        auto& tasks = get_runtime(L).tasks;
+        tasks.set_blocking(ML, true);
+        auto status = lua_resume(ML, L, 0);
+        tasks.set_blocking(ML, false);
+        if (status == LUA_OK) {
+            if (lua_gettop(ML) == 0) {
+                lua_pushstring(ML, "module must return a value");
+            } else if (not lua_istable(ML, -1) and not lua_isfunction(ML, -1)) {
+                lua_pushstring(ML, "module must return a table or function");
+            } else {
+                ok = true;
+            }
+        } else if (status == LUA_YIELD) {
+            lua_pushstring(ML, "module can not yield");
+        } else if (not lua_isstring(ML, -1)) {
+            lua_pushstring(ML, "unknown error while running module");
+        }
+    }
+    lua_xmove(ML, L, 1);
+    lua_remove(L, -2);
+    return ok;
+}
+auto bundled_require(lua_State* L) -> int {
+    auto const& bundle = *static_cast<image const*>(lua_tolightuserdata(L, lua_upvalueindex(1)));
+    auto const request = luaL_checkstring(L, 1);
+    auto ar = lua_Debug{};
+    auto index = -1;
+    if (lua_getinfo(L, 1, "s", &ar) and ar.source) {
+        if (auto const caller = bundle.by_chunkname.find(ar.source); caller != bundle.by_chunkname.end()) {
+            auto const& dependencies = bundle.modules[caller->second].dependencies;
+            if (auto const found = dependencies.find(request); found != dependencies.end()) index = found->second;
+        }
+    }
+    if (index < 0) luaL_errorL(L, "module '%s' was not bundled", request);
+    lua_getfield(L, LUA_REGISTRYINDEX, cache_key);
+    lua_rawgeti(L, -1, index + 1);
+    if (lua_isboolean(L, -1)) luaL_errorL(L, "cyclic require of '%s'", request);
+    if (not lua_isnil(L, -1)) return 1;
+    lua_pop(L, 1);
+    lua_pushboolean(L, false);
+    lua_rawseti(L, -2, index + 1);
+    if (not run_module(L, bundle.modules[index])) {
+        lua_pushnil(L);
+        lua_rawseti(L, -3, index + 1);
+        lua_error(L);
+    }
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, index + 1);
+    return 1;
+}
+}
+
+auto bundle::self() -> image const* {
+    static auto const bundle = open_image();
+    return bundle ? &*bundle : nullptr;
+}
+void bundle::open_require(lua_State* L, image const& bundle) {
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, cache_key);
+    lua_pushlightuserdata(L, const_cast<image*>(&bundle));
+    lua::push_cclosure(L, bundled_require, "require", 1);
+    lua_setglobal(L, "require");
+}
+auto bundle::load_entry(lua_State* L, image const& bundle) -> std::expected<lua_State*, std::string> {
+    auto main_thread = lua_mainthread(L);
+    auto script_thread = lua_newthread(main_thread);
+    luaL_sandboxthread(script_thread);
+    set_memory_category(script_thread, memory_category::script);
+    auto const& entry = bundle.modules.front();
+    return lua::load(script_thread, entry.bytecode, {
+        .codegen = active_build_settings().codegen,
+        .chunkname = entry.chunkname,
+        .userdata_types = userdata_types::names(),
+    }).transform([&] {
+        return script_thread;
+    }).transform_error([](auto err) {
+        return std::format("Loading error: {}", err);
+    });
+}
+auto bundle::create(fs::path const& entry, fs::path const& output) -> bool {
+    struct pending {
+        fs::path file;
+        std::string chunkname;
+        std::string bytecode;
+        std::vector<std::pair<std::string, std::uint32_t>> dependencies;
+    };
+    auto ec = std::error_code{};
+    auto const root = fs::weakly_canonical(entry, ec);
+    if (not fs::is_regular_file(root, ec)) {
+        std::println(stderr, "'{}' is not a file", entry.string());
+        return false;
+    }
+    auto modules = std::vector<pending>{{.file = root}};
+    auto indices = std::unordered_map<std::string, std::uint32_t>{{root.string(), 0}};
+    // breadth first over the require graph, every module gets an index once.
+    for (std::size_t i{}; i < modules.size(); ++i) {
+        auto const file = modules[i].file;
+        auto const source = read_file(file);
+        if (not source) {
+            std::println(stderr, "failed to read '{}'", file.string());
+            return false;
+        }
+        auto bytecode = bytecode_cache::compile(*source, compile_options());
+        // a leading zero byte means the payload is a compile error message.
+        if (bytecode.empty() or bytecode.front() == 0) {
+            std::println(stderr, "{}", std::string_view{bytecode}.substr(bytecode.empty() ? 0 : 1));
+            return false;
+        }
+        auto dependencies = std::vector<std::pair<std::string, std::uint32_t>>{};
+        for (auto& request : resolve::requires_of(*source)) {
+            if (rgs::contains(dependencies | std::views::keys, request)) continue;
+            auto const resolved = resolve::module(file, request);
+            if (not resolved) {
+                std::println(stderr, "{}", resolved.error());
+                return false;
+            }
+            auto const [found, added] = indices.emplace(resolved->string(), static_cast<std::uint32_t>(modules.size()));
+            if (added) modules.push_back({.file = *resolved});
+            dependencies.emplace_back(std::move(request), found->second);
+        }
+        auto& m = modules[i];
+        m.chunkname = "@" + file.lexically_relative(root.parent_path()).replace_extension().generic_string();
+        m.bytecode = std::move(bytecode);
+        m.dependencies = std::move(dependencies);
+    }
+    auto const executable = executable_path();
+    if (fs::equivalent(executable, output, ec)) {
+        std::println(stderr, "refusing to overwrite the running executable");
+        return false;
+    }
+    auto base = read_file(executable);
+    if (not base) {
+        std::println(stderr, "failed to read '{}'", executable.string());
+        return false;
+    }
+    // bundling from a bundled executable keeps only the executable itself.
+    if (auto const f = read_footer(executable)) base->resize(f->blobs_offset);
+    auto out = std::ofstream{output, std::ios::binary | std::ios::trunc};
+    out.write(base->data(), base->size());
+    auto index = index_writer{};
+    index.put(format_version);
+    index.put(static_cast<std::uint32_t>(modules.size()));
+    auto offset = std::uint64_t{};
+    for (auto const& m : modules) {
+        out.write(m.bytecode.data(), m.bytecode.size());
+        index.put(std::string_view{m.chunkname});
+        index.put(offset);
+        index.put(static_cast<std::uint64_t>(m.bytecode.size()));
+        index.put(static_cast<std::uint32_t>(m.dependencies.size()));
+        for (auto const& [request, target] : m.dependencies) {
+            index.put(std::string_view{request});
+            index.put(target);
+        }
+        offset += m.bytecode.size();
+    }
+    out.write(index.out.data(), index.out.size());
+    auto f = footer{
+        .blobs_offset = base->size(),
+        .index_offset = base->size() + offset,
+        .index_size = index.out.size(),
+    };
+    std::memcpy(f.magic, footer_magic.data(), sizeof(f.magic));
+    out.write(reinterpret_cast<const char*>(&f), sizeof(f));
+    out.close();
+    if (not out) {
+        std::println(stderr, "failed to write '{}'", output.string());
+        return false;
+    }
+    fs::permissions(output, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec, fs::perm_options::add, ec);
+    std::println(stderr, "bundled {} modules into '{}'", modules.size(), output.string());
+    return true;
+}
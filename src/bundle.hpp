@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+struct lua_State;
+
+// self contained executables. `wow bundle` resolves the require graph of a
+// script, precompiles every module and appends them with an index to a copy
+// of the running executable. at startup the executable maps itself and
+// runs the entry module, require then only looks into the index.
+namespace bundle {
+struct module {
+    std::string chunkname;
+    // points into the mapped executable.
+    std::span<const char> bytecode;
+    // require strings used by the module and the modules they resolved to.
+    std::unordered_map<std::string, std::uint32_t> dependencies;
+};
+struct image {
+    // the entry module comes first.
+    std::vector<module> modules;
+    std::unordered_map<std::string, std::uint32_t> by_chunkname;
+};
+// the bundle appended to the running executable, nullptr when there is none.
+auto self() -> image const*;
+auto create(std::filesystem::path const& entry, std::filesystem::path const& output) -> bool;
+// replaces require with one that only resolves bundled modules.
+void open_require(lua_State* L, image const& bundle);
+auto load_entry(lua_State* L, image const& bundle) -> std::expected<lua_State*, std::string>;
+}
@@ -0,0 +1,264 @@
+#include "bytecode_cache.hpp"
+#include <Luau/Bytecode.h>
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+namespace fs = std::filesystem;
+namespace rgs = std::ranges;
+
+namespace {
+constexpr auto magic = std::string_view{"WOWC"};
+constexpr std::uint32_t format_version = 1;
+constexpr auto entry_extension = std::string_view{".luauc"};
+// the compiler is linked statically, so a rebuild may emit different
+// bytecode under the same bytecode version.
+constexpr auto build_stamp = std::string_view{__DATE__ " " __TIME__};
+
+struct entry_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t source_check;
+    std::uint64_t source_size;
+};
+bytecode_cache::options config = [] {
+    auto opts = bytecode_cache::options{};
+    opts.directory = bytecode_cache::default_directory();
+    return opts;
+}();
+bytecode_cache::counters stat_counters{};
+struct shared_entry {
+    std::uint64_t source_check;
+    std::size_t source_size;
+    std::once_flag compiled;
+    bytecode_cache::shared_bytecode bytecode;
+};
+std::mutex registry_mutex;
+// keyed by file and compile options, an entry is replaced once the source
+// of its file changed so long lived processes only keep the latest version.
+std::unordered_map<std::string, std::shared_ptr<shared_entry>> registry;
+
+auto fnv1a(std::string_view data, std::uint64_t hash = 0xcbf29ce484222325ull) -> std::uint64_t {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+auto options_digest(lua_CompileOptions const& o) -> std::string {
+    auto digest = std::format("{}|{}|{}|{}|{}|{}|{}|{}",
+        build_stamp,
+        static_cast<int>(LBC_VERSION_TARGET),
+        static_cast<int>(LBC_TYPE_VERSION_TARGET),
+        o.optimizationLevel,
+        o.debugLevel,
+        o.typeInfoLevel,
+        o.coverageLevel,
+        o.vectorLib ? o.vectorLib : ""
+    );
+    for (auto name = o.userdataTypes; name and *name; ++name) {
+        digest.append("|").append(*name);
+    }
+    for (auto name = o.mutableGlobals; name and *name; ++name) {
+        digest.append("|").append(*name);
+    }
+    return digest;
+}
+auto entry_path(std::string_view source, lua_CompileOptions const& copts) -> fs::path {
+    auto const key = fnv1a(options_digest(copts), fnv1a(source));
+    return config.directory / std::format("{:016x}{}", key, entry_extension);
+}
+auto compile_uncached(std::string_view source, lua_CompileOptions copts) -> std::string {
+    auto outsize = size_t{};
+    auto raw = luau_compile(source.data(), source.size(), &copts, &outsize);
+    auto bytecode = std::string(raw, outsize);
+    std::free(raw);
+    return bytecode;
+}
+auto read_entry(fs::path const& path, std::uint64_t check, std::uint64_t size) -> std::optional<std::string> {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (not file) return std::nullopt;
+    auto const file_size = static_cast<size_t>(file.tellg());
+    if (file_size <= sizeof(entry_header)) return std::nullopt;
+    file.seekg(0, std::ios::beg);
+    auto header = entry_header{};
+    if (not file.read(reinterpret_cast<char*>(&header), sizeof(header))) return std::nullopt;
+    auto const valid = std::string_view{header.magic, sizeof(header.magic)} == magic
+        and header.version == format_version
+        and header.source_check == check
+        and header.source_size == size;
+    if (not valid) return std::nullopt;
+    auto bytecode = std::string(file_size - sizeof(header), '\0');
+    if (not file.read(bytecode.data(), bytecode.size())) return std::nullopt;
+    return bytecode;
+}
+auto temporary_name(fs::path const& path) -> fs::path {
+    thread_local auto engine = std::mt19937_64{std::random_device{}()};
+#ifdef _WIN32
+    auto const pid = _getpid();
+#else
+    auto const pid = getpid();
+#endif
+    auto tmp = path;
+    tmp += std::format(".{}.{:x}.tmp", pid, engine());
+    return tmp;
+}
+auto write_entry(fs::path const& path, std::uint64_t check, std::uint64_t size, std::string_view bytecode) -> bool {
+    std::error_code ec{};
+    fs::create_directories(path.parent_path(), ec);
+    if (ec) return false;
+    auto const tmp = temporary_name(path);
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (not file) return false;
+        auto header = entry_header{
+            .version = format_version,
+            .source_check = check,
+            .source_size = size,
+        };
+        rgs::copy(magic, header.magic);
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        file.write(bytecode.data(), bytecode.size());
+        if (not file.flush()) {
+            file.close();
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+    // rename is atomic, so concurrent writers of the same key simply race
+    // to publish identical contents.
+    fs::rename(tmp, path, ec);
+    if (ec) fs::remove(tmp, ec);
+    return not ec;
+}
+struct cache_size {
+    std::mutex mutex;
+    // bytes in the directory as far as this process knows, measured on the
+    // first store and after every trim.
+    std::optional<std::uintmax_t> estimate;
+} directory_size;
+// sums up the entries and evicts the least recently used ones once they
+// exceed the limit, returns what is left.
+auto trim() -> std::uintmax_t {
+    struct entry {
+        fs::path path;
+        std::uintmax_t size;
+        fs::file_time_type time;
+    };
+    std::error_code ec{};
+    auto entries = std::vector<entry>{};
+    auto total = std::uintmax_t{};
+    for (auto const& e : fs::directory_iterator(config.directory, ec)) {
+        if (e.path().extension() != entry_extension) continue;
+        auto const size = e.file_size(ec);
+        if (ec) continue;
+        auto const time = e.last_write_time(ec);
+        if (ec) continue;
+        entries.push_back({e.path(), size, time});
+        total += size;
+    }
+    if (total <= config.max_size) return total;
+    // hits touch their entry, so the write time is the time of last use.
+    rgs::sort(entries, {}, &entry::time);
+    auto const target = config.max_size / 4 * 3;
+    for (auto const& e : entries) {
+        if (total <= target) break;
+        // another process may have evicted it already.
+        if (fs::remove(e.path, ec)) ++stat_counters.evictions;
+        total -= e.size;
+    }
+    return total;
+}
+// only scans the directory when the estimate says it outgrew the limit.
+void stored(std::uintmax_t bytes) {
+    auto lock = std::scoped_lock{directory_size.mutex};
+    auto& estimate = directory_size.estimate;
+    if (not estimate) {
+        estimate = trim();
+        return;
+    }
+    *estimate += bytes;
+    if (*estimate > config.max_size) estimate = trim();
+}
+void touch(fs::path const& path) {
+    std::error_code ec{};
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+}
+}
+
+auto bytecode_cache::default_directory() -> fs::path {
+    if (auto dir = std::getenv("WOW_CACHE_DIR")) return dir;
+#ifdef _WIN32
+    if (auto local = std::getenv("LOCALAPPDATA")) return fs::path(local) / "wow" / "bytecode";
+#else
+    if (auto xdg = std::getenv("XDG_CACHE_HOME")) return fs::path(xdg) / "wow" / "bytecode";
+    if (auto home = std::getenv("HOME")) return fs::path(home) / ".cache" / "wow" / "bytecode";
+#endif
+    std::error_code ec{};
+    return fs::temp_directory_path(ec) / "wow-bytecode";
+}
+void bytecode_cache::configure(options const& opts) {
+    config = opts;
+    if (config.directory.empty()) config.directory = default_directory();
+    auto lock = std::scoped_lock{directory_size.mutex};
+    directory_size.estimate.reset();
+}
+auto bytecode_cache::enabled() -> bool {
+    return config.enabled;
+}
+auto bytecode_cache::stats() -> counters const& {
+    return stat_counters;
+}
+auto bytecode_cache::compile(std::string_view source, lua_CompileOptions const& copts) -> std::string {
+    if (not config.enabled) return compile_uncached(source, copts);
+    auto const path = entry_path(source, copts);
+    auto const check = static_cast<std::uint64_t>(std::hash<std::string_view>{}(source));
+    if (auto cached = read_entry(path, check, source.size())) {
+        ++stat_counters.hits;
+        touch(path);
+        return std::move(*cached);
+    }
+    ++stat_counters.misses;
+    auto bytecode = compile_uncached(source, copts);
+    // a leading zero byte means the payload is a compile error message.
+    if (not bytecode.empty() and bytecode.front() != 0) {
+        if (write_entry(path, check, source.size(), bytecode)) {
+            ++stat_counters.stores;
+            stored(sizeof(entry_header) + bytecode.size());
+        }
+    }
+    return bytecode;
+}
+auto bytecode_cache::compile_shared(fs::path const& file, std::string_view source, lua_CompileOptions const& copts) -> shared_bytecode {
+    auto const check = static_cast<std::uint64_t>(std::hash<std::string_view>{}(source));
+    auto ec = std::error_code{};
+    auto const canonical = fs::weakly_canonical(file, ec);
+    auto const key = std::format("{:016x}|{}", fnv1a(options_digest(copts)), (ec ? file : canonical).generic_string());
+    auto found = std::shared_ptr<shared_entry>{};
+    {
+        auto lock = std::scoped_lock{registry_mutex};
+        auto& slot = registry[key];
+        if (not slot or slot->source_check != check or slot->source_size != source.size()) {
+            slot = std::make_shared<shared_entry>(check, source.size());
+        }
+        found = slot;
+    }
+    auto compiled_here = false;
+    // other states asking for the same source wait here instead of compiling.
+    std::call_once(found->compiled, [&] {
+        found->bytecode = std::make_shared<std::string const>(compile(source, copts));
+        compiled_here = true;
+    });
+    if (not compiled_here) ++stat_counters.shared;
+    return found->bytecode;
+}
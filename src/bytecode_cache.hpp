@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <luacode.h>
+
+// content addressed on-disk cache for compiled bytecode.
+// entries are keyed by source hash, compile options and bytecode version,
+// written through a temporary file and renamed into place so concurrent
+// processes never observe partial entries.
+namespace bytecode_cache {
+struct counters {
+    std::atomic<std::size_t> hits{};
+    std::atomic<std::size_t> misses{};
+    std::atomic<std::size_t> stores{};
+    std::atomic<std::size_t> evictions{};
+    // loads served by the in-process registry.
+    std::atomic<std::size_t> shared{};
+};
+struct options {
+    bool enabled = true;
+    std::filesystem::path directory = {};
+    std::uintmax_t max_size = 64ull * 1024 * 1024;
+};
+auto default_directory() -> std::filesystem::path;
+void configure(options const& opts);
+auto enabled() -> bool;
+auto stats() -> counters const&;
+auto compile(std::string_view source, lua_CompileOptions const& copts) -> std::string;
+using shared_bytecode = std::shared_ptr<std::string const>;
+// process wide registry in front of compile, holding the latest source of
+// every file. a source is compiled once per process even when several
+// states ask for it at the same time, every state loads from the same
+// immutable bytecode. states still using an older version keep it alive.
+auto compile_shared(std::filesystem::path const& file, std::string_view source, lua_CompileOptions const& copts) -> shared_bytecode;
+}
@@ -1,8 +1,24 @@
 #include "export.hpp"
+#include "bytecode_cache.hpp"
+#include "remote.hpp"
+#include "bundle.hpp"
+#include "watch.hpp"
+#include "glob.hpp"
+#include "Luau/Coverage.h"
 #include <print>
 #include <ranges>
 #include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <algorithm>
+#include <vector>
 namespace vws = std::views;
+namespace rgs = std::ranges;
 namespace fs = std::filesystem;
 using namespace std::string_view_literals;
 
@@ -23,19 +39,281 @@ struct args_wrapper {
     explicit args_wrapper() = default;
 };
 
-static auto run_main_entry_script(args_wrapper const& args, lua::state L, std::string_view script) -> void {
-	std::println("{}", fs::current_path().string());
-    auto state = load_script(L, script);
-    if (!state) {
-        std::println("\033[35mError: {}\033[0m", state.error());
-        return;
-    }
-    for (auto arg : args.span()) lua_pushstring(*state, arg);
-    auto status = lua_resume(*state, L, args.argc);
-
-    if (status != LUA_OK) {
-        std::println("\033[35mError: {}\033[0m", luaL_checkstring(*state, -1));
+struct cli_options {
+    bool no_cache = false;
+    bool cache_stats = false;
+    unsigned jobs = 1;
+    build_profile profile = build_profile::release;
+    std::string coverage_file = "coverage.out";
+    bool profile_samples = false;
+    std::string profile_file = "profile.folded";
+    unsigned profile_rate = 1000;
+    allocator_kind allocator = allocator_kind::pool;
+    bool startup_stats = false;
+    // written by bench and bundle.
+    std::string output;
+    std::string bench_filter;
+    bool prefetch = false;
+    bool watch = false;
+    bool remote = false;
+    std::string socket_path;
+};
+static auto parse_jobs(std::string_view v) -> unsigned {
+    auto jobs = unsigned{1};
+    std::from_chars(v.data(), v.data() + v.size(), jobs);
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    return jobs;
+}
+static auto parse_options(args_wrapper const& args) -> cli_options {
+    auto opts = cli_options{};
+    for (size_t i{}; i < args.argc; ++i) {
+        auto const arg = *args[i];
+        if (arg == "--no-cache") opts.no_cache = true;
+        else if (arg == "--cache-stats") opts.cache_stats = true;
+        else if (arg == "--startup-stats") opts.startup_stats = true;
+        else if (arg == "-j") opts.jobs = parse_jobs(args[i + 1].value_or("1"));
+        else if (arg.starts_with("-j")) opts.jobs = parse_jobs(arg.substr(2));
+        else if (arg == "--release") opts.profile = build_profile::release;
+        else if (arg == "--debug") opts.profile = build_profile::debug;
+        else if (arg.starts_with("--coverage")) {
+            opts.profile = build_profile::coverage;
+            if (arg.starts_with("--coverage=")) opts.coverage_file = arg.substr(sizeof("--coverage=") - 1);
+        }
+        else if (arg.starts_with("--output=")) opts.output = arg.substr(sizeof("--output=") - 1);
+        else if (arg == "-o") opts.output = args[i + 1].value_or("");
+        else if (arg.starts_with("--filter=")) opts.bench_filter = arg.substr(sizeof("--filter=") - 1);
+        else if (arg == "--prefetch") opts.prefetch = true;
+        else if (arg == "--watch") opts.watch = true;
+        else if (arg == "--remote") opts.remote = true;
+        else if (arg.starts_with("--socket=")) opts.socket_path = arg.substr(sizeof("--socket=") - 1);
+        else if (arg == "--allocator=system") opts.allocator = allocator_kind::system;
+        else if (arg == "--allocator=pool") opts.allocator = allocator_kind::pool;
+        else if (arg.starts_with("--profile-rate=")) {
+            auto const v = arg.substr(sizeof("--profile-rate=") - 1);
+            std::from_chars(v.data(), v.data() + v.size(), opts.profile_rate);
+            opts.profile_rate = std::clamp(opts.profile_rate, 1u, 100'000u);
+        }
+        else if (arg.starts_with("--profile")) {
+            opts.profile_samples = true;
+            if (arg.starts_with("--profile=")) opts.profile_file = arg.substr(sizeof("--profile=") - 1);
+        }
     }
+    return opts;
+}
+static void print_startup_stats(lua_State* L, std::ostream& out) {
+    auto const& stats = get_runtime(L).startup;
+    constexpr auto ms = 1000.0;
+    std::println(out, "startup: state {:.3f} ms, setup {:.3f} ms, first load {:.3f} ms, {} libraries loaded in {:.3f} ms",
+        stats.state_seconds * ms,
+        stats.setup_seconds * ms,
+        stats.first_load_seconds * ms,
+        stats.libraries_loaded,
+        stats.library_seconds * ms
+    );
+}
+static void print_cache_stats() {
+    auto const& stats = bytecode_cache::stats();
+    std::println(stderr, "bytecode cache: {} hits, {} misses, {} stores, {} evictions, {} shared",
+        stats.hits.load(),
+        stats.misses.load(),
+        stats.stores.load(),
+        stats.evictions.load(),
+        stats.shared.load()
+    );
+}
+static auto run_main_entry_script(args_wrapper const& args, lua::state L, std::string_view script) -> bool {
+    auto const forwarded = std::vector<std::string_view>(args.view().begin(), args.view().end());
+    return run_script(L, script, forwarded);
+}
+// every script gets its own state, output is buffered per script and
+// flushed in submission order once all earlier scripts finished.
+static auto run_parallel(args_wrapper const& args, std::span<std::string const> scripts, unsigned jobs, bool startup_stats) -> bool {
+    struct result {
+        std::ostringstream out;
+        std::ostringstream err;
+        bool ok = false;
+        bool done = false;
+    };
+    auto results = std::vector<result>(scripts.size());
+    auto next = std::atomic<size_t>{};
+    auto ok = std::atomic<bool>{true};
+    auto flush_mutex = std::mutex{};
+    auto flushed = size_t{};
+    auto flush_ready = [&] {
+        for (; flushed < results.size() and results[flushed].done; ++flushed) {
+            auto& r = results[flushed];
+            std::cout << r.out.view() << std::flush;
+            std::cerr << r.err.view() << std::flush;
+            r = result{.done = true};
+        }
+    };
+    auto work = [&] {
+        for (auto i = next++; i < scripts.size(); i = next++) {
+            auto& r = results[i];
+            {
+                auto state = init_state({.out = &r.out, .err = &r.err});
+                r.ok = run_main_entry_script(args, state.get(), scripts[i]);
+                if (startup_stats) print_startup_stats(state.get(), r.err);
+            }
+            if (not r.ok) ok = false;
+            auto lock = std::scoped_lock{flush_mutex};
+            r.done = true;
+            flush_ready();
+        }
+    };
+    {
+        auto workers = std::vector<std::jthread>{};
+        jobs = std::min<size_t>(jobs, scripts.size());
+        for (unsigned i{}; i < jobs; ++i) workers.emplace_back(work);
+    }
+    return ok;
+}
+static auto run_scripts(args_wrapper const& args, cli_options const& opts) -> bool {
+    auto filter = vws::filter([](std::string_view e) {
+        return e.ends_with(".luau");
+    });
+    auto scripts = std::vector<std::string>{};
+    for (auto script : args.view() | filter) {
+        // wildcards the shell left alone, like 'tests/**/*.luau'.
+        if (script.find_first_of("*?[{") != script.npos) {
+            auto const pattern = glob::pattern::compile(script);
+            if (not pattern) {
+                std::println(stderr, "invalid pattern '{}': {}", script, pattern.error());
+                return false;
+            }
+            for (auto& path : glob::expand({&*pattern, 1})) {
+                if (fs::is_regular_file(path)) scripts.push_back(std::move(path));
+            }
+        } else {
+            scripts.emplace_back(script);
+        }
+    }
+    if (opts.prefetch) {
+        auto const entries = std::vector<fs::path>(scripts.begin(), scripts.end());
+        prefetch_modules(entries);
+    }
+    if (opts.watch) {
+        auto const entries = std::vector<fs::path>(scripts.begin(), scripts.end());
+        auto const forwarded = std::vector<std::string_view>(args.view().begin(), args.view().end());
+        watch::run(entries, forwarded);
+        return true;
+    }
+    auto ok = true;
+    // coverage is collected for a single state only.
+    auto const parallel = opts.jobs > 1 and scripts.size() > 1 and opts.profile != build_profile::coverage;
+    if (parallel) {
+        ok = run_parallel(args, scripts, opts.jobs, opts.startup_stats);
+    } else {
+        auto state = init_state();
+        auto L = state.get();
+        for (auto const& script : scripts) {
+            ok = run_main_entry_script(args, L, script) and ok;
+        }
+        if (opts.startup_stats) print_startup_stats(L, std::cerr);
+        if (opts.profile == build_profile::coverage) coverageDump(opts.coverage_file.c_str());
+    }
+    return ok;
+}
+static auto collect_bench_files(args_wrapper const& args) -> std::vector<std::string> {
+    auto files = std::vector<std::string>{};
+    auto add_directory = [&](fs::path const& dir) {
+        auto found = std::vector<std::string>{};
+        for (auto const& entry : fs::recursive_directory_iterator(dir)) {
+            if (entry.is_regular_file() and entry.path().extension() == ".luau") {
+                found.push_back(entry.path().string());
+            }
+        }
+        rgs::sort(found);
+        rgs::move(found, std::back_inserter(files));
+    };
+    for (size_t i = 2; i < args.argc; ++i) {
+        auto const arg = *args[i];
+        if (arg.starts_with("-") or args[i - 1] == "-j"sv or args[i - 1] == "-o"sv) continue;
+        if (fs::is_directory(arg)) add_directory(arg);
+        else files.emplace_back(arg);
+    }
+    if (files.empty() and fs::is_directory("bench")) add_directory("bench");
+    return files;
+}
+// runs every benchmark the files register through wow.bench.add and emits
+// the results as json, progress and script output go to stderr.
+static auto run_benchmarks(args_wrapper const& args, cli_options const& opts) -> bool {
+    lib::bench::collect = true;
+    auto ok = true;
+    auto results = nlohmann::json::array();
+    for (auto const& file : collect_bench_files(args)) {
+        std::println(stderr, "{}", file);
+        auto state = init_state({.out = &std::cerr});
+        auto L = state.get();
+        if (not run_main_entry_script(args, L, file)) {
+            ok = false;
+            continue;
+        }
+        for (auto const& r : lib::bench::run_registered(L, opts.bench_filter)) {
+            std::println(stderr, "  {}", lib::bench::summary(r));
+            if (not r.error.empty()) ok = false;
+            auto json = lib::bench::to_json(r);
+            json["file"] = file;
+            results.push_back(std::move(json));
+        }
+    }
+    auto const report = nlohmann::json{
+        {"version", 1},
+        {"build", __DATE__ " " __TIME__},
+        {"profile", build_profile_name(opts.profile)},
+        {"allocator", opts.allocator == allocator_kind::pool ? "pool" : "system"},
+        {"results", std::move(results)},
+    };
+    if (opts.output.empty()) {
+        std::println("{}", report.dump(2));
+    } else if (auto file = std::ofstream{opts.output}) {
+        file << report.dump(2) << '\n';
+    } else {
+        std::println(stderr, "failed to write '{}'", opts.output);
+        return false;
+    }
+    return ok;
+}
+static auto socket_path(cli_options const& opts) -> fs::path {
+    return opts.socket_path.empty() ? remote::default_socket() : fs::path{opts.socket_path};
+}
+// sends the script to the daemon started with `wow serve`, which runs it
+// with the arguments in one of its warm states.
+static auto run_remote(args_wrapper const& args, cli_options const& opts) -> bool {
+    auto const forwarded = std::vector<std::string_view>(args.view().begin(), args.view().end());
+    auto const script = rgs::find_if(forwarded, [](std::string_view e) {
+        return e.ends_with(".luau");
+    });
+    if (script == forwarded.end()) {
+        std::println(stderr, "no script to run");
+        return false;
+    }
+    auto const code = remote::run(socket_path(opts), *script, forwarded);
+    if (not code) std::println(stderr, "no daemon is serving on '{}', start one with 'wow serve'", socket_path(opts).string());
+    return code == 0;
+}
+// wow bundle main.luau -o tool
+static auto create_bundle(args_wrapper const& args, cli_options const& opts) -> bool {
+    auto entry = std::optional<std::string_view>{};
+    for (size_t i = 2; i < args.argc and not entry; ++i) {
+        if (args[i]->ends_with(".luau") and args[i - 1] != "-o"sv) entry = args[i];
+    }
+    if (not entry) {
+        std::println(stderr, "no entry script to bundle");
+        return false;
+    }
+    auto output = opts.output.empty() ? fs::path{*entry}.stem() : fs::path{opts.output};
+#ifdef _WIN32
+    if (not output.has_extension()) output += ".exe";
+#endif
+    return bundle::create(*entry, output);
+}
+// a bundled executable runs its entry module with every argument, none of
+// them are options of wow.
+static auto run_bundled(args_wrapper const& args, bundle::image const& bundle) -> int {
+    auto state = init_state();
+    auto const forwarded = std::vector<std::string_view>(args.view().begin(), args.view().end());
+    return run_bundle(state.get(), bundle, forwarded) ? 0 : 1;
 }
 template <typename T>
 constexpr auto as() {
@@ -46,27 +324,23 @@ constexpr auto as() {
 
 auto main(int argc, char** argv) -> int {
     auto args = args_wrapper{argc, argv};
-    auto state = init_state("pls");
-    auto L = state.get();
-    auto scripts = vws::filter([](std::string_view e) {
-        return e.ends_with(".luau");
-    });
-    auto args_sv = args.view() | as<std::string_view>();
-    for (auto script : args.view() | scripts) {
-        constexpr auto wildcard = "*.luau"sv;
-        if (script.ends_with(wildcard)) {
-            auto dir = fs::path(script).parent_path();
-            for (auto entry : fs::directory_iterator(dir)) {
-                auto const path = entry.path();
-                if (not entry.is_regular_file() or path.extension() != ".luau") {
-                    continue;
-                }
-                run_main_entry_script(args, L, path.string());
-            }
-        } else {
-            run_main_entry_script(args, L, script);
-        }
+    init_process();
+    if (auto const bundled = bundle::self()) return run_bundled(args, *bundled);
+    auto const opts = parse_options(args);
+    bytecode_cache::configure({.enabled = not opts.no_cache});
+    active_build_profile = opts.profile;
+    active_allocator = opts.allocator;
+    if (opts.profile_samples) {
+        profiler::start(std::chrono::microseconds{1'000'000 / opts.profile_rate});
     }
+    auto const command = args[1].value_or("");
+    auto const ok = command == "bench"sv ? run_benchmarks(args, opts)
+        : command == "bundle"sv ? create_bundle(args, opts)
+        : command == "serve"sv ? remote::serve(socket_path(opts), opts.jobs)
+        : command == "run"sv and opts.remote ? run_remote(args, opts)
+        : run_scripts(args, opts);
+    if (opts.profile_samples) profiler::stop(opts.profile_file, std::cerr);
+    if (opts.cache_stats) print_cache_stats();
     //std::system("pause");
-    return 0;
+    return ok ? 0 : 1;
 }
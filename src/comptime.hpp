@@ -1,11 +1,15 @@
 #pragma once
 #include <source_location>
+#include <cassert>
 #include <utility>
 #include <string_view>
 #include <ranges>
 #include <string>
 #include <algorithm>
 #include <type_traits>
+#include <array>
+#include <bit>
+#include <cstdint>
 
 namespace comptime {
 template<typename T, T Val>
@@ -78,7 +82,7 @@ consteval EnumInfo enum_info_impl() {
 }
 #elif defined(__clang__) || defined(__GNUC__)
 template <SentinelEnum T, T Value>
-consteval enum_info_t enum_info_impl() {
+consteval EnumInfo enum_info_impl() {
     using sv = std::string_view;
     const sv raw{std::source_location::current().function_name()};
     const sv enum_find{"T = "}; 
@@ -138,4 +142,51 @@ constexpr EnumItem<T> enum_item(auto value) {
         .value = info.value
     };
 }
+// seeded fnv-1a with a final avalanche, so every seed spreads the names
+// over the low bits differently.
+constexpr auto seeded_hash(std::string_view str, std::uint32_t seed) -> std::uint32_t {
+    auto h = std::uint32_t{2166136261u} ^ seed;
+    for (unsigned char c : str) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+// collision free name lookup for the items of an enum. searches a seed at
+// compile time for which every name lands in its own slot of a table with
+// 8 slots per name, lookups then cost one hash and one string compare.
+template <SentinelEnum T>
+struct perfect_hash {
+    static constexpr auto items = to_array<T>();
+    static constexpr std::size_t slot_count = std::bit_ceil(items.size() * 8);
+    struct table_t {
+        std::uint32_t seed;
+        std::array<std::int16_t, slot_count> slots;
+    };
+    static consteval auto build() -> table_t {
+        constexpr auto max_seed = std::uint32_t{1} << 16;
+        for (std::uint32_t seed = 1; seed < max_seed; ++seed) {
+            auto table = table_t{.seed = seed};
+            table.slots.fill(-1);
+            auto collided = false;
+            for (std::size_t i{}; i < items.size() and not collided; ++i) {
+                auto& slot = table.slots[seeded_hash(items[i].name, seed) & (slot_count - 1)];
+                collided = slot >= 0;
+                slot = static_cast<std::int16_t>(i);
+            }
+            if (not collided) return table;
+        }
+        throw "no perfect hash seed found";
+    }
+    static constexpr auto table = build();
+    // value of the item with the name, -1 when there is none.
+    static constexpr auto find(std::string_view name) -> int {
+        auto const i = table.slots[seeded_hash(name, table.seed) & (slot_count - 1)];
+        if (i < 0 or items[i].name != name) return -1;
+        return items[i].value;
+    }
+};
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <expected>
 #include <filesystem>
+#include <span>
 #include <lualib.h>
 #include <Luau/Require.h>
 #include "lua/lua.hpp"
@@ -12,10 +13,32 @@
 #include <lib/proc/export.hpp>
 #include <lib/fs/export.hpp>
 #include <lib/http/export.hpp>
+#include <lib/task/export.hpp>
+#include <lib/bench/export.hpp>
+#include <lib/thread/export.hpp>
+#include <lib/shm/export.hpp>
 #include <httplib.h>
-auto init_state(const char* libname = "lib") -> lua::state_owner;
+#include "runtime.hpp"
+struct state_config {
+    std::ostream* out = &std::cout;
+    std::ostream* err = &std::cerr;
+};
+// process wide setup shared by every state, called once before the first init_state.
+void init_process();
+auto init_state(state_config const& config = {}) -> lua::state_owner;
 auto load_script(lua_State* L, const std::filesystem::path& path) -> std::expected<lua_State*, std::string>;
 void open_require(lua_State* L);
+// reads and compiles the static require graph of the scripts on the worker
+// pool, so their requires later hit the shared bytecode registry.
+void prefetch_modules(std::span<std::filesystem::path const> entries);
+// drops cached modules when any of their source files changed since they were loaded.
+void invalidate_stale_modules(lua_State* L);
+// loads the script into a fresh sandboxed thread, runs it with the given
+// arguments and then everything it scheduled.
+auto run_script(lua_State* L, std::filesystem::path const& script, std::span<std::string_view const> args) -> bool;
+namespace bundle {struct image;}
+// runs the entry module of a bundle like run_script.
+auto run_bundle(lua_State* L, bundle::image const& bundle, std::span<std::string_view const> args) -> bool;
 
 using loader = void(*)(lua_State*L, int idx);
 template <loader F>
@@ -36,27 +59,100 @@ constexpr void open(lua_State* L, const char* name) {
     lua_setglobal(L, name);
 }
 
+// userdata types known to the compiler and to native codegen, names map
+// back to the userdata tags of their lua::type<T> through the codegen remapper.
+template <typename ...Ts>
+struct userdata_registry {
+    static auto names() -> const char* const* {
+        static const char* names[] = {lua::type<Ts>::config.tname()..., nullptr};
+        return names;
+    }
+    static auto tag(std::string_view name) -> int {
+        auto tag = -1;
+        ((name == lua::type<Ts>::config.type and (tag = lua::type<Ts>::config.tag, true)) or ...);
+        return tag;
+    }
+};
+using userdata_types = userdata_registry<
+    lib::fs::path,
+    glob::pattern,
+    lib::http::client,
+    lib::http::response,
+    lib::io::filewriter,
+    lib::io::filereader,
+    lib::io::writer,
+    lib::io::reader,
+    lib::io::mapped_file_handle,
+    lib::thread::channel_handle,
+    lib::thread::worker,
+    lib::shm::ring_handle
+>;
+// selected once at startup, decides what scripts are compiled and run with.
+enum class build_profile {
+    release,
+    debug,
+    coverage,
+};
+struct build_settings {
+    int optimization_level;
+    int debug_level;
+    int type_info_level;
+    int coverage_level;
+    bool codegen;
+};
+inline auto active_build_profile = build_profile::release;
+constexpr auto build_settings_for(build_profile profile) -> build_settings {
+    switch (profile) {
+        case build_profile::debug: return {
+            .optimization_level = 1,
+            .debug_level = 2,
+            .type_info_level = 1,
+            .coverage_level = 0,
+            .codegen = false,
+        };
+        case build_profile::coverage: return {
+            .optimization_level = 1,
+            .debug_level = 2,
+            .type_info_level = 1,
+            .coverage_level = 2,
+            .codegen = false,
+        };
+        default: return {
+            .optimization_level = 2,
+            .debug_level = 1,
+            .type_info_level = 1,
+            .coverage_level = 0,
+            .codegen = true,
+        };
+    }
+}
+constexpr auto build_profile_name(build_profile profile) -> const char* {
+    switch (profile) {
+        case build_profile::debug: return "debug";
+        case build_profile::coverage: return "coverage";
+        default: return "release";
+    }
+}
+inline auto active_build_settings() -> build_settings {
+    return build_settings_for(active_build_profile);
+}
 template <lua::compile_options_ish T = lua_CompileOptions>
 constexpr auto compile_options() -> T {
-    using lua::type;
-    static const char* userdata_types[] = {
-        type<lib::fs::path>::config.tname(),
-        type<lib::http::client>::config.tname(),
-        type<lib::http::response>::config.tname(),
-        type<lib::io::filewriter>::config.tname(),
-        type<lib::io::filereader>::config.tname(),
-        type<lib::io::writer>::config.tname(),
-        type<lib::io::reader>::config.tname(),
-        nullptr
-    };
+    auto const settings = active_build_settings();
     auto opts = T{};
-    opts.optimizationLevel = 2;
-    opts.debugLevel = 3;
-    opts.typeInfoLevel = 2;
-    opts.coverageLevel = 2;
-    //opts.userdataTypes = userdata_types;
+    opts.optimizationLevel = settings.optimization_level;
+    opts.debugLevel = settings.debug_level;
+    opts.typeInfoLevel = settings.type_info_level;
+    opts.coverageLevel = settings.coverage_level;
+    opts.userdataTypes = userdata_types::names();
     return opts;
 }
+// backing allocator of new states, selected once at startup.
+enum class allocator_kind {
+    pool,
+    system,
+};
+inline auto active_allocator = allocator_kind::pool;
 enum class read_file_error {
     not_a_file,
     failed_to_open,
@@ -0,0 +1,352 @@
+#include "glob.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <utility>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+namespace fs = std::filesystem;
+using glob::pattern;
+using position = pattern::position;
+using token_kind = pattern::token_kind;
+using segment_kind = pattern::segment_kind;
+
+// a pattern like {a,b}{c,d}{e,f}... doubles with every group.
+constexpr auto max_alternatives = std::size_t{1024};
+
+// expands the first brace group and recurses on what comes out of it, an
+// unclosed brace stays literal.
+static auto expand_braces(std::string_view source, std::vector<std::string>& out) -> bool {
+    auto open = source.npos;
+    for (std::size_t i{}; i < source.size(); ++i) {
+        if (source[i] == '\\') ++i;
+        else if (source[i] == '{') {
+            open = i;
+            break;
+        }
+    }
+    auto close = source.npos;
+    auto parts = std::vector<std::string_view>{};
+    if (open != source.npos) {
+        auto depth = 0;
+        auto part_begin = open + 1;
+        for (auto i = open; i < source.size() and close == source.npos; ++i) {
+            switch (source[i]) {
+                case '\\': ++i; break;
+                case '{': ++depth; break;
+                case ',':
+                    if (depth != 1) break;
+                    parts.push_back(source.substr(part_begin, i - part_begin));
+                    part_begin = i + 1;
+                    break;
+                case '}':
+                    if (--depth != 0) break;
+                    parts.push_back(source.substr(part_begin, i - part_begin));
+                    close = i;
+                    break;
+            }
+        }
+    }
+    if (close == source.npos) {
+        out.emplace_back(source);
+        return out.size() <= max_alternatives;
+    }
+    auto const head = source.substr(0, open);
+    auto const tail = source.substr(close + 1);
+    for (auto const part : parts) {
+        auto alternative = std::string{head};
+        alternative.append(part).append(tail);
+        if (not expand_braces(alternative, out)) return false;
+    }
+    return true;
+}
+static void add_literal(std::vector<pattern::token>& tokens, char c) {
+    if (tokens.empty() or tokens.back().kind != token_kind::literal) {
+        tokens.push_back({.kind = token_kind::literal});
+    }
+    tokens.back().text.push_back(c);
+}
+// the class starting at the [ at from, nullopt when it is never closed.
+// a ] right after the opening bracket is a member.
+static auto parse_set(std::string_view text, std::size_t from, std::size_t& end) -> std::optional<std::bitset<256>> {
+    auto i = from + 1;
+    auto const negated = i < text.size() and (text[i] == '!' or text[i] == '^');
+    if (negated) ++i;
+    auto set = std::bitset<256>{};
+    for (auto first = true; i < text.size(); ++i, first = false) {
+        auto c = static_cast<unsigned char>(text[i]);
+        if (c == ']' and not first) {
+            end = i;
+            if (negated) set.flip();
+            return set;
+        }
+        if (c == '\\' and i + 1 < text.size()) c = static_cast<unsigned char>(text[++i]);
+        if (i + 2 < text.size() and text[i + 1] == '-' and text[i + 2] != ']') {
+            auto const last = static_cast<unsigned char>(text[i + 2]);
+            for (auto v = static_cast<unsigned>(c); v <= last; ++v) set.set(v);
+            i += 2;
+        } else {
+            set.set(c);
+        }
+    }
+    return std::nullopt;
+}
+static auto parse_segment(std::string_view text) -> pattern::segment {
+    if (text == "**") return {.kind = segment_kind::globstar};
+    auto tokens = std::vector<pattern::token>{};
+    for (std::size_t i{}; i < text.size(); ++i) {
+        auto const c = text[i];
+        if (c == '\\' and i + 1 < text.size()) {
+            add_literal(tokens, text[++i]);
+        } else if (c == '*') {
+            if (tokens.empty() or tokens.back().kind != token_kind::star) tokens.push_back({.kind = token_kind::star});
+        } else if (c == '?') {
+            tokens.push_back({.kind = token_kind::any});
+        } else if (auto end = std::size_t{}; c == '[') {
+            if (auto set = parse_set(text, i, end)) {
+                tokens.push_back({.kind = token_kind::set, .set = *set});
+                i = end;
+            } else {
+                add_literal(tokens, c);
+            }
+        } else {
+            add_literal(tokens, c);
+        }
+    }
+    if (tokens.size() == 1 and tokens.front().kind == token_kind::literal) {
+        return {.kind = segment_kind::literal, .text = std::move(tokens.front().text)};
+    }
+    return {.kind = segment_kind::wildcard, .tokens = std::move(tokens)};
+}
+static auto strip_current(std::string_view& path) {
+    while (path.starts_with("./")) path.remove_prefix(2);
+}
+auto pattern::compile(std::string_view source) -> std::expected<pattern, std::string> {
+    auto self = pattern{};
+    self.source_ = source;
+    while (source.starts_with('!')) {
+        self.negated_ = not self.negated_;
+        source.remove_prefix(1);
+    }
+    strip_current(source);
+    if (source.empty()) return std::unexpected("empty pattern");
+    auto expanded = std::vector<std::string>{};
+    if (not expand_braces(source, expanded)) {
+        return std::unexpected(std::format("more than {} alternatives", max_alternatives));
+    }
+    for (std::string_view text : expanded) {
+        auto alt = alternative{.absolute = text.starts_with('/')};
+        for (auto const part : text | std::views::split('/')) {
+            auto const segment = std::string_view{part.begin(), part.end()};
+            if (segment.empty() or segment == ".") continue;
+            // a**b is just a*b, only whole segments span directories.
+            alt.segments.push_back(parse_segment(segment));
+        }
+        auto const literal = std::ranges::find_if(alt.segments, [](segment const& s) {
+            return s.kind != segment_kind::literal;
+        }) - alt.segments.begin();
+        // the last segment is still matched against a listing.
+        alt.literal_prefix = alt.segments.empty() ? 0 : std::min<std::size_t>(literal, alt.segments.size() - 1);
+        self.alternatives_.push_back(std::move(alt));
+    }
+    return self;
+}
+// classic wildcard matching, the last star is the only backtracking point.
+auto pattern::segment::match(std::string_view name) const -> bool {
+    if (kind == segment_kind::globstar) return true;
+    if (kind == segment_kind::literal) return name == text;
+    auto t = std::size_t{};
+    auto n = std::size_t{};
+    auto star = std::string_view::npos;
+    auto star_n = std::size_t{};
+    while (n < name.size() or t < tokens.size()) {
+        if (t < tokens.size()) {
+            auto const& token = tokens[t];
+            switch (token.kind) {
+                case token_kind::star:
+                    star = t++;
+                    star_n = n;
+                    continue;
+                case token_kind::any:
+                    if (n == name.size()) break;
+                    ++t, ++n;
+                    continue;
+                case token_kind::set:
+                    if (n == name.size() or not token.set[static_cast<unsigned char>(name[n])]) break;
+                    ++t, ++n;
+                    continue;
+                case token_kind::literal:
+                    if (not name.substr(n).starts_with(token.text)) break;
+                    t++, n += token.text.size();
+                    continue;
+            }
+        }
+        if (star == std::string_view::npos or star_n == name.size()) return false;
+        t = star + 1;
+        n = ++star_n;
+    }
+    return true;
+}
+void pattern::step(std::span<position const> from, std::string_view name, std::vector<position>& to) const {
+    auto add = [&](position p) {
+        if (not std::ranges::contains(to, p)) to.push_back(p);
+    };
+    for (auto const p : from) {
+        auto const& segments = alternatives_[p.alternative].segments;
+        for (auto s = p.segment; s < segments.size(); ++s) {
+            // a globstar takes the name, or matches nothing and lets the
+            // next segment try.
+            if (segments[s].kind == segment_kind::globstar) {
+                add({p.alternative, s});
+                continue;
+            }
+            if (segments[s].match(name)) add({p.alternative, s + 1});
+            break;
+        }
+    }
+}
+auto pattern::accepts(std::span<position const> at) const -> bool {
+    return std::ranges::any_of(at, [this](position p) {
+        auto const& segments = alternatives_[p.alternative].segments;
+        return std::all_of(segments.begin() + p.segment, segments.end(), [](segment const& s) {
+            return s.kind == segment_kind::globstar;
+        });
+    });
+}
+auto pattern::alive(std::span<position const> at) const -> bool {
+    return std::ranges::any_of(at, [this](position p) {
+        return p.segment < alternatives_[p.alternative].segments.size();
+    });
+}
+auto pattern::start(std::string_view& path) const -> std::vector<position> {
+    strip_current(path);
+    auto const absolute = path.starts_with('/');
+    auto positions = std::vector<position>{};
+    for (std::uint32_t i{}; i < alternatives_.size(); ++i) {
+        if (alternatives_[i].absolute == absolute) positions.push_back({i, 0});
+    }
+    return positions;
+}
+// positions after every segment of the path.
+static auto walk_path(pattern const& self, std::vector<position> positions, std::string_view path) -> std::vector<position> {
+    auto next = std::vector<position>{};
+    for (auto const part : path | std::views::split('/')) {
+        auto const name = std::string_view{part.begin(), part.end()};
+        if (name.empty() or name == ".") continue;
+        next.clear();
+        self.step(positions, name, next);
+        std::swap(positions, next);
+        if (positions.empty()) break;
+    }
+    return positions;
+}
+auto pattern::match(std::string_view path) const -> bool {
+    auto positions = start(path);
+    return accepts(walk_path(*this, std::move(positions), path)) != negated_;
+}
+auto pattern::may_contain(std::string_view directory) const -> bool {
+    if (negated_) return true;
+    auto positions = start(directory);
+    return alive(walk_path(*this, std::move(positions), directory));
+}
+
+static auto join(std::string_view directory, std::string_view name) -> std::string {
+    auto path = std::string{directory};
+    if (not path.empty() and not path.ends_with('/')) path.push_back('/');
+    return path.append(name);
+}
+using directory_queue = std::vector<std::pair<std::string, std::vector<position>>>;
+// matches the entries of the directory against the positions, names are
+// only copied into a path once they matched. directories that can still
+// match are queued rather than entered, the read buffer is left behind.
+static void scan_directory(pattern const& self, std::string const& directory, std::span<position const> positions, std::vector<std::string>& out, directory_queue& descend) {
+    auto next = std::vector<position>{};
+    auto visit = [&](std::string_view name, bool is_directory) {
+        if (name == "." or name == "..") return;
+        next.clear();
+        self.step(positions, name, next);
+        if (next.empty()) return;
+        auto path = join(directory, name);
+        if (self.accepts(next)) out.push_back(path);
+        if (is_directory and self.alive(next)) descend.emplace_back(std::move(path), next);
+    };
+#ifdef __linux__
+    struct linux_dirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+    auto const dir = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) return;
+    alignas(linux_dirent64) char buffer[32 * 1024];
+    for (long size; (size = ::syscall(SYS_getdents64, dir, buffer, sizeof(buffer))) > 0;) {
+        for (long at{}; at < size;) {
+            auto const d = reinterpret_cast<linux_dirent64 const*>(buffer + at);
+            at += d->d_reclen;
+            auto is_directory = d->d_type == DT_DIR;
+            if (d->d_type == DT_UNKNOWN) {
+                struct stat info{};
+                is_directory = ::fstatat(dir, d->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0 and S_ISDIR(info.st_mode);
+            }
+            visit(d->d_name, is_directory);
+        }
+    }
+    ::close(dir);
+#else
+    auto ec = std::error_code{};
+    for (auto const& entry : fs::directory_iterator{directory.empty() ? fs::path{"."} : fs::path{directory}, fs::directory_options::skip_permission_denied, ec}) {
+        auto const status = entry.symlink_status(ec);
+        visit(entry.path().filename().string(), fs::is_directory(status));
+    }
+#endif
+}
+// walks the tree with an explicit queue, deep trees do not grow the stack.
+static void scan(pattern const& self, std::string const& directory, std::span<position const> positions, std::vector<std::string>& out) {
+    auto pending = directory_queue{};
+    pending.emplace_back(directory, std::vector<position>(positions.begin(), positions.end()));
+    while (not pending.empty()) {
+        auto [path, at] = std::move(pending.back());
+        pending.pop_back();
+        scan_directory(self, path, at, out, pending);
+    }
+}
+auto glob::expand(std::span<pattern const> patterns) -> std::vector<std::string> {
+    auto found = std::vector<std::string>{};
+    for (auto const& p : patterns) {
+        if (p.negated()) continue;
+        // alternatives sharing a literal prefix share the directory listing.
+        auto roots = std::map<std::string, std::vector<position>>{};
+        auto const alternatives = p.alternatives();
+        for (std::uint32_t i{}; i < alternatives.size(); ++i) {
+            auto const& alt = alternatives[i];
+            if (alt.segments.empty()) continue;
+            auto root = std::string{alt.absolute ? "/" : ""};
+            for (std::size_t s{}; s < alt.literal_prefix; ++s) root = join(root, alt.segments[s].text);
+            roots[root].push_back({i, static_cast<std::uint32_t>(alt.literal_prefix)});
+        }
+        for (auto const& [root, positions] : roots) {
+            auto ec = std::error_code{};
+            if (not root.empty() and not fs::is_directory(root, ec)) continue;
+            scan(p, root, positions, found);
+        }
+    }
+    std::ranges::sort(found);
+    auto const duplicates = std::ranges::unique(found);
+    found.erase(duplicates.begin(), duplicates.end());
+    std::erase_if(found, [&](std::string const& path) {
+        return std::ranges::any_of(patterns, [&](pattern const& p) {
+            return p.negated() and not p.match(path);
+        });
+    });
+    return found;
+}
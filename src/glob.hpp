@@ -0,0 +1,76 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// compiled glob patterns, shared by fs.glob, fs.walk and the script
+// wildcards of the cli. paths are matched a segment at a time, * and ?
+// stay within a segment, ** as a whole segment spans any number of them,
+// [...] takes ranges with ! or ^ for negation and {a,b} alternation nests.
+// a leading ! negates the whole pattern.
+namespace glob {
+class pattern {
+public:
+    static auto compile(std::string_view source) -> std::expected<pattern, std::string>;
+    // the path is taken relative, a leading ./ is ignored.
+    auto match(std::string_view path) const -> bool;
+    // whether something below the directory could match, walks prune on it.
+    auto may_contain(std::string_view directory) const -> bool;
+    auto negated() const -> bool {return negated_;}
+    auto source() const -> std::string const& {return source_;}
+    enum class token_kind : std::uint8_t {
+        literal,
+        any,
+        star,
+        set,
+    };
+    struct token {
+        token_kind kind;
+        std::string text;
+        std::bitset<256> set;
+    };
+    enum class segment_kind : std::uint8_t {
+        literal,
+        wildcard,
+        globstar,
+    };
+    struct segment {
+        segment_kind kind;
+        std::string text;
+        std::vector<token> tokens;
+        // compares raw bytes, allocates nothing.
+        auto match(std::string_view name) const -> bool;
+    };
+    // one alternative of the brace expansion.
+    struct alternative {
+        bool absolute;
+        std::vector<segment> segments;
+        // leading literal segments, they name a directory to start from.
+        std::size_t literal_prefix;
+    };
+    struct position {
+        std::uint32_t alternative;
+        std::uint32_t segment;
+        friend auto operator==(position, position) -> bool = default;
+    };
+    // positions reached after the path segment name.
+    void step(std::span<position const> from, std::string_view name, std::vector<position>& to) const;
+    auto accepts(std::span<position const> at) const -> bool;
+    auto alive(std::span<position const> at) const -> bool;
+    auto alternatives() const -> std::span<alternative const> {return alternatives_;}
+private:
+    auto start(std::string_view& path) const -> std::vector<position>;
+    std::string source_;
+    bool negated_ = false;
+    std::vector<alternative> alternatives_;
+};
+// existing paths that match one of the patterns and none of the negated
+// ones, sorted. descent starts at the literal prefix of every alternative
+// and stops where no alternative can match anymore. symlinks are listed
+// but not followed.
+auto expand(std::span<pattern const> patterns) -> std::vector<std::string>;
+}
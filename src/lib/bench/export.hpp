@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+struct lua_State;
+
+namespace lib::bench {
+// timings are nanoseconds per iteration, allocation counts are per iteration.
+struct result {
+    std::string name;
+    std::string error;
+    std::uint64_t iterations{};
+    std::uint64_t samples{};
+    double mean{};
+    double median{};
+    double mad{};
+    double min{};
+    double max{};
+    double p10{};
+    double p90{};
+    double p99{};
+    double allocations{};
+    double allocated_bytes{};
+};
+void library(lua_State* L, int idx);
+// when set bench.add only registers, the host runs them with run_registered.
+// otherwise bench.add measures right away and prints a summary line.
+inline bool collect = false;
+auto run_registered(lua_State* L, std::string_view filter = {}) -> std::vector<result>;
+auto to_json(result const& r) -> nlohmann::json;
+auto summary(result const& r) -> std::string;
+}
@@ -0,0 +1,232 @@
+#include "export.hpp"
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include "lua/json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <numeric>
+#include <lualib.h>
+namespace rgs = std::ranges;
+using clock_type = std::chrono::steady_clock;
+using ns_t = std::chrono::duration<double, std::nano>;
+using sec_t = std::chrono::duration<double>;
+constexpr auto registry_key = "wow.bench";
+
+namespace {
+struct options {
+    double warmup = 0.1;
+    double time = 0.5;
+    double sample_time = 0.001;
+    int min_samples = 10;
+    int max_samples = 1000;
+};
+struct pending_run {
+    lib::bench::result* out;
+    options opts;
+};
+auto read_options(lua_State* L, int idx) -> options {
+    auto opts = options{};
+    if (lua_isnoneornil(L, idx)) return opts;
+    luaL_checktype(L, idx, LUA_TTABLE);
+    auto field = [&](const char* key, auto fallback) {
+        lua_getfield(L, idx, key);
+        auto valid = 0;
+        auto const v = lua_tonumberx(L, -1, &valid);
+        lua_pop(L, 1);
+        return valid ? static_cast<decltype(fallback)>(v) : fallback;
+    };
+    opts.warmup = std::max(field("warmup", opts.warmup), 0.0);
+    opts.time = std::max(field("time", opts.time), 0.0);
+    opts.sample_time = std::max(field("sample_time", opts.sample_time), 1e-6);
+    opts.min_samples = std::max(field("min_samples", opts.min_samples), 1);
+    opts.max_samples = std::max(field("max_samples", opts.max_samples), opts.min_samples);
+    return opts;
+}
+// linear interpolation between the closest ranks of sorted values.
+auto percentile(std::vector<double> const& sorted, double p) -> double {
+    if (sorted.empty()) return 0;
+    auto const rank = p * (sorted.size() - 1);
+    auto const low = static_cast<std::size_t>(std::floor(rank));
+    auto const high = std::min(low + 1, sorted.size() - 1);
+    return sorted[low] + (sorted[high] - sorted[low]) * (rank - low);
+}
+auto calls(lua_State* L, int fn, std::uint64_t n) -> double {
+    auto const start = clock_type::now();
+    for (std::uint64_t i{}; i < n; ++i) {
+        lua_pushvalue(L, fn);
+        lua_call(L, 0, 0);
+    }
+    return ns_t{clock_type::now() - start}.count();
+}
+void measure(lua_State* L, int fn, options const& opts, lib::bench::result& r) {
+    auto& heap = get_runtime(L).heap;
+    // warmup doubles as the estimate of a single call.
+    auto warmup_calls = std::uint64_t{};
+    auto warmup_ns = 0.0;
+    do {
+        warmup_ns += calls(L, fn, 1);
+        ++warmup_calls;
+    } while (warmup_ns < opts.warmup * 1e9);
+    auto const per_call = std::max(warmup_ns / warmup_calls, 1.0);
+    auto const batch = std::max<std::uint64_t>(1, std::llround(opts.sample_time * 1e9 / per_call));
+
+    auto per_iteration = std::vector<double>{};
+    per_iteration.reserve(opts.max_samples);
+    auto const allocations = heap.allocations;
+    auto const allocated = heap.allocated_bytes;
+    auto const start = clock_type::now();
+    auto const min_samples = static_cast<std::size_t>(opts.min_samples);
+    auto const max_samples = static_cast<std::size_t>(opts.max_samples);
+    while (per_iteration.size() < max_samples) {
+        per_iteration.push_back(calls(L, fn, batch) / batch);
+        auto const elapsed = sec_t{clock_type::now() - start}.count();
+        if (per_iteration.size() >= min_samples and elapsed >= opts.time) break;
+    }
+    r.samples = per_iteration.size();
+    r.iterations = r.samples * batch;
+    r.allocations = static_cast<double>(heap.allocations - allocations) / r.iterations;
+    r.allocated_bytes = static_cast<double>(heap.allocated_bytes - allocated) / r.iterations;
+
+    rgs::sort(per_iteration);
+    r.min = per_iteration.front();
+    r.max = per_iteration.back();
+    r.mean = std::accumulate(per_iteration.begin(), per_iteration.end(), 0.0) / r.samples;
+    r.median = percentile(per_iteration, 0.5);
+    r.p10 = percentile(per_iteration, 0.1);
+    r.p90 = percentile(per_iteration, 0.9);
+    r.p99 = percentile(per_iteration, 0.99);
+    auto deviations = per_iteration;
+    for (auto& v : deviations) v = std::abs(v - r.median);
+    rgs::sort(deviations);
+    r.mad = percentile(deviations, 0.5);
+}
+// upvalue free entry point so measurement errors can be caught with pcall.
+auto protected_measure(lua_State* L) -> int {
+    auto& run = *static_cast<pending_run*>(lua_tolightuserdata(L, 1));
+    measure(L, 2, run.opts, *run.out);
+    return lua::none;
+}
+auto run_protected(lua_State* L, int fn, options const& opts, std::string name) -> lib::bench::result {
+    auto r = lib::bench::result{.name = std::move(name)};
+    auto run = pending_run{.out = &r, .opts = opts};
+    fn = lua_absindex(L, fn);
+    lua_pushcfunction(L, protected_measure, "bench.measure");
+    lua_pushlightuserdata(L, &run);
+    lua_pushvalue(L, fn);
+    if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+        r.error = lua::tostring(L, -1);
+        lua_pop(L, 1);
+    }
+    return r;
+}
+auto format_time(double ns) -> std::string {
+    if (ns < 1e3) return std::format("{:.1f} ns", ns);
+    if (ns < 1e6) return std::format("{:.2f} us", ns / 1e3);
+    if (ns < 1e9) return std::format("{:.2f} ms", ns / 1e6);
+    return std::format("{:.2f} s", ns / 1e9);
+}
+}
+
+static auto run(lua_State* L) -> int {
+    auto const name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    auto const opts = read_options(L, 3);
+    auto r = lib::bench::result{.name = name};
+    measure(L, 2, opts, r);
+    return lua::json::push_value(L, lib::bench::to_json(r));
+}
+static auto add(lua_State* L) -> int {
+    auto const name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if (not lib::bench::collect) {
+        auto const r = run_protected(L, 2, read_options(L, 3), name);
+        *get_runtime(L).out << lib::bench::summary(r) << '\n';
+        return lua::none;
+    }
+    // validated now, read again when the host runs it.
+    read_options(L, 3);
+    lua_settop(L, 3);
+    lua_getfield(L, LUA_REGISTRYINDEX, registry_key);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, registry_key);
+    }
+    lua_createtable(L, 3, 0);
+    for (int i = 1; i <= 3; ++i) {
+        lua_pushvalue(L, i);
+        lua_rawseti(L, -2, i);
+    }
+    lua_rawseti(L, -2, lua_objlen(L, -2) + 1);
+    lua_pop(L, 1);
+    return lua::none;
+}
+static auto now(lua_State* L) -> int {
+    return lua::push(L, sec_t{clock_type::now().time_since_epoch()}.count());
+}
+void lib::bench::library(lua_State* L, int idx) {
+    lua::set_functions(L, idx, std::to_array<luaL_Reg>({
+        {"add", add},
+        {"run", run},
+        {"now", now},
+    }));
+}
+auto lib::bench::run_registered(lua_State* L, std::string_view filter) -> std::vector<result> {
+    auto results = std::vector<result>{};
+    lua_getfield(L, LUA_REGISTRYINDEX, registry_key);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return results;
+    }
+    auto const count = lua_objlen(L, -1);
+    for (int i = 1; i <= count; ++i) {
+        lua_rawgeti(L, -1, i);
+        lua_rawgeti(L, -1, 1);
+        auto name = std::string{lua::tostring(L, -1)};
+        lua_pop(L, 1);
+        if (filter.empty() or name.contains(filter)) {
+            lua_rawgeti(L, -1, 2);
+            lua_rawgeti(L, -2, 3);
+            auto const opts = read_options(L, lua_gettop(L));
+            results.push_back(run_protected(L, -2, opts, std::move(name)));
+            lua_pop(L, 2);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, registry_key);
+    return results;
+}
+auto lib::bench::to_json(result const& r) -> nlohmann::json {
+    auto json = nlohmann::json{
+        {"name", r.name},
+        {"iterations", r.iterations},
+        {"samples", r.samples},
+        {"mean_ns", r.mean},
+        {"median_ns", r.median},
+        {"mad_ns", r.mad},
+        {"min_ns", r.min},
+        {"max_ns", r.max},
+        {"p10_ns", r.p10},
+        {"p90_ns", r.p90},
+        {"p99_ns", r.p99},
+        {"allocations", r.allocations},
+        {"allocated_bytes", r.allocated_bytes},
+    };
+    if (not r.error.empty()) json["error"] = r.error;
+    return json;
+}
+auto lib::bench::summary(result const& r) -> std::string {
+    if (not r.error.empty()) return std::format("{:<36} error: {}", r.name, r.error);
+    return std::format("{:<36} {:>10} ±{:>10}  {:>8.1f} allocs {:>10.0f} B",
+        r.name,
+        format_time(r.median),
+        format_time(r.mad),
+        r.allocations,
+        r.allocated_bytes
+    );
+}
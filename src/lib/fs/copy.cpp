@@ -0,0 +1,489 @@
+#include "export.hpp"
+#include "lua/lua.hpp"
+#include "runtime.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <expected>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+namespace fs = std::filesystem;
+using lib::fs::to_path;
+
+// fs.copy, a tree copy on a bounded share of the worker pool. files are cloned
+// with FICLONE where the filesystem shares extents and copied in the kernel
+// with copy_file_range otherwise, so the data never passes through the
+// process. the copy_options keep the meaning they have for fs::copy.
+namespace {
+struct copy_settings {
+    fs::copy_options options = fs::copy_options::none;
+    bool dry_run = false;
+    unsigned threads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+    // between progress reports, none without a progress callback.
+    std::optional<std::chrono::duration<double>> interval;
+};
+struct copy_stats {
+    std::uint64_t files;
+    std::uint64_t directories;
+    std::uint64_t symlinks;
+    std::uint64_t bytes;
+    std::uint64_t skipped;
+    std::uint64_t reflinked;
+    double seconds;
+};
+auto has(fs::copy_options options, fs::copy_options flag) -> bool {
+    return (options & flag) != fs::copy_options::none;
+}
+auto to_copy_options(std::string_view str) -> fs::copy_options {
+    using fs::copy_options;
+    if (str == "recursive") {
+        return copy_options::recursive;
+    } else if (str == "update existing") {
+        return copy_options::update_existing;
+    } else if (str == "skip existing") {
+        return copy_options::skip_existing;
+    } else if (str == "create symlinks") {
+        return copy_options::create_symlinks;
+    } else if (str == "copy symlinks") {
+        return copy_options::copy_symlinks;
+    } else if (str == "skip symlinks") {
+        return copy_options::skip_symlinks;
+    } else if (str == "overwrite existing") {
+        return copy_options::overwrite_existing;
+    } else if (str == "directories only") {
+        return copy_options::directories_only;
+    } else if (str == "create hard links") {
+        return copy_options::create_hard_links;
+    } else {
+        return copy_options::none;
+    }
+}
+#ifdef __linux__
+// bytes copied, a reflink shares the extents and copies nothing.
+struct copied {
+    std::uint64_t bytes;
+    bool reflinked;
+};
+auto copy_contents(fs::path const& from, fs::path const& to) -> std::expected<copied, std::error_code> {
+    auto const error = [] {return std::unexpected(std::error_code{errno, std::system_category()});};
+    auto const in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return error();
+    struct stat info{};
+    if (::fstat(in, &info) != 0) {
+        auto const e = error();
+        ::close(in);
+        return e;
+    }
+    // the mode is set again once the contents are in, open applies the umask.
+    auto const out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 07777);
+    if (out < 0) {
+        auto const e = error();
+        ::close(in);
+        return e;
+    }
+    auto result = std::expected<copied, std::error_code>{copied{.bytes = static_cast<std::uint64_t>(info.st_size)}};
+    if (::ioctl(out, FICLONE, in) == 0) {
+        result->reflinked = true;
+        ::fchmod(out, info.st_mode & 07777);
+    } else {
+        auto remaining = static_cast<std::uint64_t>(info.st_size);
+        auto kernel = true;
+        while (remaining > 0) {
+            auto const n = kernel ? ::copy_file_range(in, nullptr, out, nullptr, remaining, 0) : -1;
+            if (n > 0) {
+                remaining -= n;
+                continue;
+            }
+            if (n == 0) break;
+            // not across these filesystems, copy the rest through a buffer.
+            if (kernel and (errno == EXDEV or errno == ENOSYS or errno == EINVAL or errno == EOPNOTSUPP)) {
+                kernel = false;
+                auto chunk = std::vector<char>(1 << 20);
+                for (ssize_t r; remaining > 0 and (r = ::read(in, chunk.data(), chunk.size())) > 0;) {
+                    for (ssize_t w{}; w < r;) {
+                        auto const written = ::write(out, chunk.data() + w, r - w);
+                        if (written < 0) {
+                            result = error();
+                            break;
+                        }
+                        w += written;
+                    }
+                    if (not result) break;
+                    remaining -= std::min<std::uint64_t>(remaining, r);
+                }
+                break;
+            }
+            result = error();
+            break;
+        }
+        if (result) ::fchmod(out, info.st_mode & 07777);
+    }
+    ::close(in);
+    ::close(out);
+    return result;
+}
+#endif
+
+// entries are copied by at most settings.threads jobs on the worker pool,
+// which only run while there are entries queued.
+class copy_job : public std::enable_shared_from_this<copy_job> {
+public:
+    using waiter = std::move_only_function<void()>;
+    copy_job(fs::path from, fs::path to, copy_settings settings):
+        settings_(settings), target_(std::move(to)), root_{.from = std::move(from), .to = target_, .depth = 0} {}
+    void start() {
+        push(std::move(root_));
+    }
+    // drops what is still queued, entries being copied finish.
+    void stop() {
+        auto lock = std::unique_lock{mutex_};
+        stopping_ = true;
+        pending_ -= tasks_.size();
+        tasks_.clear();
+        if (pending_ == 0) report(lock, true);
+    }
+    // calls the waiter once the copy finished, or once an entry finished
+    // after the interval passed when there is one. right away when done.
+    void when_reported(waiter w) {
+        auto lock = std::unique_lock{mutex_};
+        if (pending_ == 0) {
+            lock.unlock();
+            w();
+            return;
+        }
+        waiter_ = std::move(w);
+        if (settings_.interval) report_at_ = clock::now() + std::chrono::duration_cast<clock::duration>(*settings_.interval);
+    }
+    // blocks until the next progress report is due, for threads that can not park.
+    void wait() {
+        auto lock = std::unique_lock{mutex_};
+        auto const finished = [this] {return pending_ == 0;};
+        if (settings_.interval) done_.wait_for(lock, *settings_.interval, finished);
+        else done_.wait(lock, finished);
+    }
+    auto finished() -> bool {
+        auto lock = std::scoped_lock{mutex_};
+        return pending_ == 0;
+    }
+    auto stats() const -> copy_stats {
+        return {
+            .files = files_,
+            .directories = directories_,
+            .symlinks = symlinks_,
+            .bytes = bytes_,
+            .skipped = skipped_,
+            .reflinked = reflinked_,
+            .seconds = std::chrono::duration<double>{clock::now() - start_}.count(),
+        };
+    }
+    auto failure() -> std::optional<std::string> {
+        auto lock = std::scoped_lock{mutex_};
+        return failure_;
+    }
+    auto settings() const -> copy_settings const& {return settings_;}
+    auto target() const -> fs::path const& {return target_;}
+private:
+    using clock = std::chrono::steady_clock;
+    struct task {
+        fs::path from;
+        fs::path to;
+        int depth;
+    };
+    void push(task t) {
+        auto spawn = false;
+        {
+            auto lock = std::scoped_lock{mutex_};
+            if (stopping_ or failure_) return;
+            ++pending_;
+            tasks_.push_back(std::move(t));
+            spawn = runners_ < settings_.threads;
+            if (spawn) ++runners_;
+        }
+        if (spawn) worker_pool::shared().submit([self = shared_from_this()] {self->work();});
+    }
+    // copies queued entries until none are left.
+    void work() {
+        auto lock = std::unique_lock{mutex_};
+        while (not tasks_.empty()) {
+            auto t = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            run(t);
+            lock.lock();
+            --pending_;
+            report(lock, pending_ == 0);
+        }
+        --runners_;
+    }
+    // hands off to the waiter, which is called without the lock.
+    void report(auto& lock, bool finished) {
+        if (finished) done_.notify_all();
+        if (not waiter_ or not (finished or (settings_.interval and clock::now() >= report_at_))) return;
+        auto w = std::exchange(waiter_, {});
+        lock.unlock();
+        w();
+        lock.lock();
+    }
+    // the first error stops the copy, queued entries are dropped.
+    void fail(std::string message) {
+        auto lock = std::unique_lock{mutex_};
+        if (failure_) return;
+        failure_ = std::move(message);
+        pending_ -= tasks_.size();
+        tasks_.clear();
+        if (pending_ == 0) report(lock, true);
+    }
+    void fail(fs::path const& path, std::error_code ec) {
+        fail(std::format("'{}': {}", path.string(), ec.message()));
+    }
+    void run(task const& t) {
+        auto const options = settings_.options;
+        auto ec = std::error_code{};
+        auto const follow = not has(options, fs::copy_options::copy_symlinks) and not has(options, fs::copy_options::skip_symlinks);
+        auto const status = follow ? fs::status(t.from, ec) : fs::symlink_status(t.from, ec);
+        if (ec or not fs::exists(status)) return fail(t.from, ec ? ec : std::make_error_code(std::errc::no_such_file_or_directory));
+        if (fs::is_symlink(status)) {
+            if (has(options, fs::copy_options::skip_symlinks)) {
+                ++skipped_;
+                return;
+            }
+            if (not settings_.dry_run) fs::copy_symlink(t.from, t.to, ec);
+            if (ec) return fail(t.to, ec);
+            ++symlinks_;
+        } else if (fs::is_regular_file(status)) {
+            if (has(options, fs::copy_options::directories_only)) return;
+            auto to = t.to;
+            if (t.depth == 0 and fs::is_directory(to, ec)) to /= t.from.filename();
+            copy_file(t.from, to);
+        } else if (fs::is_directory(status)) {
+            // without recursive only the top level entries are copied,
+            // like fs::copy with no options.
+            if (t.depth > 0 and not has(options, fs::copy_options::recursive)) return;
+            if (t.depth == 0 and not has(options, fs::copy_options::recursive) and options != fs::copy_options::none) return;
+            if (not settings_.dry_run and not fs::exists(t.to, ec)) {
+                fs::create_directory(t.to, t.from, ec);
+                if (ec) return fail(t.to, ec);
+            }
+            ++directories_;
+            for (auto const& entry : fs::directory_iterator{t.from, ec}) {
+                push({.from = entry.path(), .to = t.to / entry.path().filename(), .depth = t.depth + 1});
+            }
+            if (ec) return fail(t.from, ec);
+        } else {
+            ++skipped_;
+        }
+    }
+    void copy_file(fs::path const& from, fs::path const& to) {
+        auto const options = settings_.options;
+        auto ec = std::error_code{};
+        if (fs::exists(to, ec)) {
+            if (fs::equivalent(from, to, ec)) return fail(std::format("'{}' and '{}' are the same file", from.string(), to.string()));
+            if (has(options, fs::copy_options::skip_existing)) {
+                ++skipped_;
+                return;
+            }
+            if (has(options, fs::copy_options::update_existing) and fs::last_write_time(from, ec) <= fs::last_write_time(to, ec)) {
+                ++skipped_;
+                return;
+            }
+            auto const replace = has(options, fs::copy_options::overwrite_existing) or has(options, fs::copy_options::update_existing);
+            if (not replace) return fail(to, std::make_error_code(std::errc::file_exists));
+        }
+        auto const size = fs::file_size(from, ec);
+        if (ec) return fail(from, ec);
+        if (settings_.dry_run) {
+            ++files_;
+            bytes_ += size;
+            return;
+        }
+        if (has(options, fs::copy_options::create_symlinks)) {
+            fs::create_symlink(fs::absolute(from), to, ec);
+            if (ec) return fail(to, ec);
+            ++symlinks_;
+            return;
+        }
+        if (has(options, fs::copy_options::create_hard_links)) {
+            fs::create_hard_link(from, to, ec);
+            if (ec) return fail(to, ec);
+            ++files_;
+            return;
+        }
+#ifdef __linux__
+        auto const result = copy_contents(from, to);
+        if (not result) return fail(to, result.error());
+        bytes_ += result->bytes;
+        if (result->reflinked) ++reflinked_;
+#else
+        fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+        if (ec) return fail(to, ec);
+        bytes_ += size;
+#endif
+        ++files_;
+    }
+
+    copy_settings settings_;
+    fs::path target_;
+    task root_;
+    clock::time_point start_ = clock::now();
+    std::atomic<std::uint64_t> files_{};
+    std::atomic<std::uint64_t> directories_{};
+    std::atomic<std::uint64_t> symlinks_{};
+    std::atomic<std::uint64_t> bytes_{};
+    std::atomic<std::uint64_t> skipped_{};
+    std::atomic<std::uint64_t> reflinked_{};
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::deque<task> tasks_;
+    // entries queued or being copied.
+    std::size_t pending_ = 0;
+    unsigned runners_ = 0;
+    bool stopping_ = false;
+    std::optional<std::string> failure_;
+    waiter waiter_;
+    clock::time_point report_at_;
+};
+// held by the driver, stops the copy when it is dropped before it finished.
+struct copy_job_owner {
+    std::shared_ptr<copy_job> job;
+    ~copy_job_owner() {
+        if (job) job->stop();
+    }
+};
+
+void push_stats(lua_State* L, copy_stats const& stats, bool dry_run) {
+    lua_createtable(L, 0, 10);
+    auto set = [&](const char* name, double value) {
+        lua_pushnumber(L, value);
+        lua_setfield(L, -2, name);
+    };
+    set("files", static_cast<double>(stats.files));
+    set("directories", static_cast<double>(stats.directories));
+    set("symlinks", static_cast<double>(stats.symlinks));
+    set("bytes", static_cast<double>(stats.bytes));
+    set("skipped", static_cast<double>(stats.skipped));
+    set("reflinked", static_cast<double>(stats.reflinked));
+    set("seconds", stats.seconds);
+    auto const seconds = std::max(stats.seconds, 1e-9);
+    set("filespersecond", static_cast<double>(stats.files) / seconds);
+    set("bytespersecond", static_cast<double>(stats.bytes) / seconds);
+    lua_pushboolean(L, dry_run);
+    lua_setfield(L, -2, "dryrun");
+}
+auto to_copy_settings(lua_State* L, int idx) -> copy_settings {
+    auto settings = copy_settings{};
+    if (lua_isstring(L, idx)) {
+        settings.options = to_copy_options(lua_tostring(L, idx));
+        return settings;
+    }
+    if (not lua_istable(L, idx)) return settings;
+    lua_getfield(L, idx, "options");
+    if (lua_isstring(L, -1)) {
+        settings.options = to_copy_options(lua_tostring(L, -1));
+    } else if (lua_istable(L, -1)) {
+        for (int i{1}; lua_rawgeti(L, -1, i) == LUA_TSTRING; ++i) {
+            settings.options |= to_copy_options(lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_getfield(L, idx, "dryrun");
+    settings.dry_run = lua_toboolean(L, -1);
+    lua_getfield(L, idx, "threads");
+    if (lua_isnumber(L, -1)) settings.threads = std::clamp(lua_tointeger(L, -1), 1, 64);
+    lua_getfield(L, idx, "interval");
+    if (lua_isnumber(L, -1)) settings.interval = std::chrono::duration<double>{std::max(lua_tonumber(L, -1), 0.01)};
+    lua_pop(L, 4);
+    return settings;
+}
+// start(from, to, options) -> job, progress
+auto copy_start(lua_State* L) -> int {
+    auto from = to_path(L, 1);
+    auto to = to_path(L, 2);
+    auto settings = to_copy_settings(L, 3);
+    auto has_progress = false;
+    if (lua_istable(L, 3)) {
+        lua_getfield(L, 3, "progress");
+        has_progress = lua_isfunction(L, -1);
+        if (not has_progress) lua_pop(L, 1);
+    }
+    if (has_progress and not settings.interval) settings.interval = std::chrono::milliseconds{250};
+    if (not has_progress) settings.interval.reset();
+    auto& owner = lua::make_userdata<copy_job_owner>(L, std::make_shared<copy_job>(std::move(from), std::move(to), settings));
+    owner.job->start();
+    if (has_progress) lua_insert(L, -2);
+    else lua_pushnil(L);
+    return 2;
+}
+// stats and whether the copy finished, raises the first error once it did.
+auto report(std::shared_ptr<copy_job> job) -> scheduler::continuation {
+    return [job = std::move(job)](lua_State* L) {
+        auto const finished = job->finished();
+        if (finished) {
+            if (auto failure = job->failure()) {
+                lua::push(L, *failure);
+                return scheduler::raise;
+            }
+            lib::fs::invalidate_stat(L, job->target());
+        }
+        push_stats(L, job->stats(), job->settings().dry_run);
+        lua::push(L, finished);
+        return 2;
+    };
+}
+// wait(job) -> stats, finished
+auto copy_wait(lua_State* L) -> int {
+    auto job = lua::to_userdata<copy_job_owner>(L, 1).job;
+    auto& tasks = get_runtime(L).tasks;
+    if (not tasks.owns(L)) {
+        job->wait();
+        auto const nresults = report(std::move(job))(L);
+        if (nresults == scheduler::raise) lua_error(L);
+        return nresults;
+    }
+    // parked rather than awaited, the copy itself runs on the pool.
+    return tasks.park(L, [job](scheduler::waker wake) {
+        job->when_reported([job, wake = std::move(wake)]() mutable {wake(report(job));});
+    });
+}
+// a c function can not yield again after it was resumed, so the loop
+// that waits for progress reports and calls back is a luau function.
+constexpr auto copy_driver = R"(
+local start, wait = ...
+return function(from, to, options)
+    local job, progress = start(from, to, options)
+    while true do
+        local stats, finished = wait(job)
+        if finished then
+            return stats
+        end
+        progress(stats)
+    end
+end
+)";
+}
+void lib::fs::push_copy(lua_State* L) {
+    auto const loaded = lua::compile_and_load(L, copy_driver, {}, {.codegen = false, .chunkname = "=fs.copy"});
+    assert(loaded);
+    lua::push_cfunction(L, copy_start, "copy_start");
+    lua::push_cfunction(L, copy_wait, "copy_wait");
+    lua_call(L, 2, 1);
+}
@@ -1,5 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <expected>
 #include <filesystem>
+#include <system_error>
+#include "glob.hpp"
 struct lua_State;
 
 namespace lib::fs {
@@ -8,4 +12,46 @@ using path = std::filesystem::path;
 auto to_path(lua_State* L, int idx) -> path;
 auto push_directory_iterator(lua_State* L, const path& path, bool recursive) -> int;
 auto push_path(lua_State* L, const path& path) -> int;
+// fs.walk(dir, options), see walk.cpp.
+auto walk(lua_State* L) -> int;
+// a globpattern or a string compiled on the spot, errors on bad patterns.
+auto to_globpattern(lua_State* L, int idx) -> glob::pattern;
+auto globpattern_create(lua_State* L) -> int;
+// fs.glob(patterns), the paths matching a pattern or a list of them.
+auto glob_paths(lua_State* L) -> int;
+enum class file_type : std::uint8_t {
+    unknown,
+    file,
+    directory,
+    symlink,
+    other,
+};
+struct file_status {
+    file_type type;
+    // type and permission bits like st_mode.
+    std::uint32_t mode;
+    std::uint64_t size;
+    // nanoseconds since the epoch.
+    std::int64_t mtime;
+    std::uint64_t inode;
+};
+using stat_result = std::expected<file_status, std::error_code>;
+// one statx call on linux, lstat semantics unless follow is set.
+auto stat_file(const path& path, bool follow) -> stat_result;
+// stat_file through the stat cache of the state while fs.statcache has it
+// enabled. only call from the thread running the state.
+auto cached_stat(lua_State* L, const path& path, bool follow) -> stat_result;
+// drops the cached results of the path, of what is below it and of its
+// parent. the mutating fs functions call it for the paths they touch.
+void invalidate_stat(lua_State* L, const path& path);
+// the stat cache lives for one script run, run_script resets it.
+void reset_stat_cache(lua_State* L);
+// what fs.type reports, directory for links to one.
+auto type_name(lua_State* L, const path& path) -> const char*;
+auto stat(lua_State* L) -> int;
+auto lstat(lua_State* L) -> int;
+auto statmany(lua_State* L) -> int;
+auto statcache(lua_State* L) -> int;
+// pushes fs.copy, see copy.cpp.
+void push_copy(lua_State* L);
 }
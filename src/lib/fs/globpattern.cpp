@@ -0,0 +1,77 @@
+#include "export.hpp"
+#include "glob.hpp"
+#include "named_atom.hpp"
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+#include <format>
+#include <string>
+#include <vector>
+using glob::pattern;
+using type = lua::type<pattern>;
+
+static auto compile_or_error(lua_State* L, std::string_view source) -> pattern {
+    auto compiled = pattern::compile(source);
+    if (not compiled) luaL_errorL(L, "invalid glob pattern '%s': %s", std::string{source}.c_str(), compiled.error().c_str());
+    return std::move(*compiled);
+}
+auto lib::fs::to_globpattern(lua_State* L, int idx) -> pattern {
+    if (auto p = type::to_if(L, idx)) return *p;
+    return compile_or_error(L, luaL_checkstring(L, idx));
+}
+auto lib::fs::globpattern_create(lua_State* L) -> int {
+    type::make(L, compile_or_error(L, luaL_checkstring(L, 1)));
+    return 1;
+}
+static auto push_paths(lua_State* L, std::vector<std::string> const& paths) -> int {
+    lua_createtable(L, static_cast<int>(paths.size()), 0);
+    for (int i{}; i < static_cast<int>(paths.size()); ++i) {
+        lua::push(L, paths[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+// the listing runs on the pool, the calling thread yields until it is done.
+static auto expand(lua_State* L, std::vector<pattern> patterns) -> int {
+    return get_runtime(L).tasks.await(L, [patterns = std::move(patterns)]() -> scheduler::continuation {
+        return [paths = glob::expand(patterns)](lua_State* L) {return push_paths(L, paths);};
+    });
+}
+auto lib::fs::glob_paths(lua_State* L) -> int {
+    auto patterns = std::vector<pattern>{};
+    if (lua_istable(L, 1)) {
+        for (int i{1}; lua_rawgeti(L, 1, i) != LUA_TNIL; ++i) {
+            patterns.push_back(to_globpattern(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    } else {
+        patterns.push_back(to_globpattern(L, 1));
+    }
+    return expand(L, std::move(patterns));
+}
+static constexpr auto methods = lua::method_table<pattern, named_atom>{
+    {named_atom::match, [](lua_State* L, pattern& self) -> int {
+        return lua::push(L, self.match(lib::fs::to_path(L, 2).generic_string()));
+    }},
+    {named_atom::expand, [](lua_State* L, pattern& self) -> int {
+        return expand(L, {self});
+    }},
+};
+TYPE_CONFIG (pattern) {
+    .type = "globpattern",
+    .on_setup = [](lua_State* L) {
+        using props = lua::properties<pattern>;
+        props::add(L, "source", [](lua_State* L, pattern const& self) {
+            return lua::push(L, self.source());
+        });
+        props::add(L, "isnegated", [](lua_State* L, pattern const& self) {
+            return lua::push(L, self.negated());
+        });
+    },
+    .namecall = lua::namecall<pattern, methods>,
+    .tostring = [](lua_State* L) {
+        return lua::push(L, std::format("globpattern(\"{}\")", type::to(L, 1).source()));
+    },
+    .index = lua::properties<pattern>::index,
+};
@@ -7,6 +7,7 @@
 #include <cassert>
 #include <expected>
 #include "lua/typeutility.hpp"
+#include "runtime.hpp"
 #include <array>
 #ifdef _WIN32
 #include <Windows.h>
@@ -32,47 +33,36 @@ static auto get_home_path() -> std::expected<std::filesystem::path, std::string>
         } else return std::unexpected(errmsg);
     #endif
 }
-static auto to_copy_options(std::string_view str) -> std::filesystem::copy_options {
-    using std::filesystem::copy_options;
-    if (str == "recursive") {
-        return copy_options::recursive;
-    } else if (str == "update existing") {
-        return copy_options::update_existing;
-    } else if (str == "skip existing") {
-        return copy_options::skip_existing;
-    } else if (str == "create symlinks") {
-        return copy_options::create_symlinks;
-    } else if (str == "copy symlinks") {
-        return copy_options::copy_symlinks;
-    } else if (str == "skip symlinks") {
-        return copy_options::skip_symlinks;
-    } else if (str == "overwrite existing") {
-        return copy_options::overwrite_existing;
-    } else if (str == "directories only") {
-        return copy_options::directories_only;
-    } else if (str == "create hard links") {
-        return copy_options::create_hard_links;
-    } else {
-        return copy_options::none;
-    }
-}
 // filesystem
 static auto remove(lua_State* L) -> int {
-    std::error_code err{};
-    int count{};
-    if (luaL_optboolean(L, 2, false)) {
-        count = std::filesystem::remove_all(to_path(L, 1), err);
-    } else {
-        count = std::filesystem::remove(to_path(L, 1), err);
-    }
-    error_on_code(L, err);
-    return lua::push(L, count);
+    auto path = to_path(L, 1);
+    auto const all = luaL_optboolean(L, 2, false);
+    return get_runtime(L).tasks.await(L, [path = std::move(path), all]() -> scheduler::continuation {
+        std::error_code err{};
+        int count{};
+        if (all) {
+            count = std::filesystem::remove_all(path, err);
+        } else {
+            count = std::filesystem::remove(path, err);
+        }
+        // remove_all may have deleted part of the tree before it failed.
+        return [count, path = std::move(path), message = err ? err.message() : std::string{}](lua_State* L) {
+            lib::fs::invalidate_stat(L, path);
+            if (not message.empty()) {
+                lua::push(L, message);
+                return scheduler::raise;
+            }
+            return lua::push(L, count);
+        };
+    });
 }
 static auto rename(lua_State* L) -> int {
     std::error_code ec{};
     auto from = to_path(L, 1);
     auto to = to_path(L, 2);
     std::filesystem::rename(from, to, ec);
+    lib::fs::invalidate_stat(L, from);
+    lib::fs::invalidate_stat(L, to);
     if (ec) {
         luaL_errorL(L, "%s", ec.message().c_str());
     }
@@ -87,6 +77,7 @@ static auto newdir(auto L) -> int {
     } else {
         created = std::filesystem::create_directory(path, ec);
     }
+    lib::fs::invalidate_stat(L, path);
     error_on_code(L, ec);
     return lua::push(L, created);
 }
@@ -99,14 +90,10 @@ static auto currdir(auto L) -> int {
     return lib::fs::push_path(L, std::filesystem::current_path());
 }
 static auto exists(auto L) -> int {
-    return lua::push(L, std::filesystem::exists(to_path(L, 1)));
+    return lua::push(L, lib::fs::cached_stat(L, to_path(L, 1), true).has_value());
 }
 static auto type(auto L) -> int {
-    auto const path = to_path(L, 1);
-    if (std::filesystem::is_directory(path)) return lua::push(L, "directory");
-    else if (std::filesystem::is_symlink(path)) return lua::push(L, "symlink");
-    else if (std::filesystem::is_regular_file(path)) return lua::push(L, "file");
-    else return lua::push(L, "unknown");
+    return lua::push(L, lib::fs::type_name(L, to_path(L, 1)));
 }
 static auto tmpdir(auto L) -> int {
     std::error_code ec{};
@@ -137,24 +124,6 @@ static auto absolute(auto L) {
     error_on_code(L, ec);
     return lib::fs::push_path(L, path);
 }
-static auto copy(auto L) -> int {
-    std::error_code ec{};
-    const auto from = to_path(L, 1);
-    const auto to = to_path(L, 2);
-    auto opts = std::filesystem::copy_options::none;
-    if (lua_isstring(L, 3)) {
-        opts = to_copy_options(lua_tostring(L, 3));
-    }
-    if (std::filesystem::is_regular_file(from)) {
-        std::filesystem::copy_file(from, to, opts, ec);
-    } else if (std::filesystem::is_symlink(from)) {
-        std::filesystem::copy_symlink(from, to, ec);
-    } else {
-        std::filesystem::copy(from, to, opts, ec);
-    }
-    error_on_code(L, ec);
-    return lua::none;
-}
 static auto newsym(auto L) -> int {
     std::error_code ec{};
     auto to = to_path(L, 1);
@@ -164,6 +133,7 @@ static auto newsym(auto L) -> int {
     } else {
         std::filesystem::create_symlink(to, new_symlink, ec);
     }
+    lib::fs::invalidate_stat(L, new_symlink);
     error_on_code(L, ec);
     return lua::none;
 }
@@ -207,7 +177,7 @@ auto lib::fs::push_directory_iterator(lua_State* L, const path& directory, bool
     if (not recursive) {
         lua::make_userdata<std::filesystem::directory_iterator>(L, directory);
         lib::fs::push_path(L,{});
-        lua_pushcclosure(L,
+        lua::push_cclosure(L,
             directory_iterator_closure<std::filesystem::directory_iterator>,
             "directory_iterator",
             2
@@ -215,7 +185,7 @@ auto lib::fs::push_directory_iterator(lua_State* L, const path& directory, bool
     } else {
         lua::make_userdata<std::filesystem::recursive_directory_iterator>(L, directory);
         lib::fs::push_path(L,{});
-        lua_pushcclosure(
+        lua::push_cclosure(
             L,
             directory_iterator_closure<std::filesystem::recursive_directory_iterator>,
             "recursive_directory_iterator",
@@ -238,12 +208,20 @@ void lib::fs::library(lua_State* L, int idx) {
         {"equivalent", equivalent},
         {"canonical", canonical},
         {"absolute", absolute},
-        {"copy", copy},
         {"newsym", newsym},
         {"path", path_create},
         {"getenv", getenv},
         {"readsym", readsym},
         {"homedir", homedir},
+        {"walk", walk},
+        {"glob", glob_paths},
+        {"globpattern", globpattern_create},
+        {"stat", stat},
+        {"lstat", lstat},
+        {"statmany", statmany},
+        {"statcache", statcache},
     }));
+    push_copy(L);
+    lua_setfield(L, idx, "copy");
 }
 
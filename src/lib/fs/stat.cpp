@@ -0,0 +1,222 @@
+#include "export.hpp"
+#include "lua/lua.hpp"
+#include "runtime.hpp"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+using lib::fs::file_status;
+using lib::fs::file_type;
+using lib::fs::stat_result;
+using lib::fs::to_path;
+namespace fs = std::filesystem;
+
+constexpr auto file_type_names = std::to_array<const char*>({
+    "unknown",
+    "file",
+    "directory",
+    "symlink",
+    "other",
+});
+// results per absolute path, negative ones included. a symlink elsewhere
+// that points into a changed path keeps its stale followed result.
+struct stat_cache {
+    struct entry {
+        std::optional<stat_result> followed;
+        std::optional<stat_result> own;
+    };
+    std::map<std::string, entry, std::less<>> entries;
+};
+constexpr auto cache_key = "_STATCACHE";
+
+#ifndef _WIN32
+static auto to_file_type(std::uint32_t mode) -> file_type {
+    if (S_ISREG(mode)) return file_type::file;
+    if (S_ISDIR(mode)) return file_type::directory;
+    if (S_ISLNK(mode)) return file_type::symlink;
+    return file_type::other;
+}
+#endif
+auto lib::fs::stat_file(const path& path, bool follow) -> stat_result {
+#if defined(__linux__)
+    struct statx info{};
+    auto const flags = AT_STATX_SYNC_AS_STAT | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    constexpr auto mask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+    if (::statx(AT_FDCWD, path.c_str(), flags, mask, &info) != 0) {
+        return std::unexpected(std::error_code{errno, std::system_category()});
+    }
+    return file_status{
+        .type = to_file_type(info.stx_mode),
+        .mode = info.stx_mode,
+        .size = info.stx_size,
+        .mtime = static_cast<std::int64_t>(info.stx_mtime.tv_sec) * 1'000'000'000 + info.stx_mtime.tv_nsec,
+        .inode = info.stx_ino,
+    };
+#elif !defined(_WIN32)
+    struct ::stat info{};
+    if ((follow ? ::stat(path.c_str(), &info) : ::lstat(path.c_str(), &info)) != 0) {
+        return std::unexpected(std::error_code{errno, std::system_category()});
+    }
+    return file_status{
+        .type = to_file_type(info.st_mode),
+        .mode = static_cast<std::uint32_t>(info.st_mode),
+        .size = static_cast<std::uint64_t>(info.st_size),
+        .mtime = static_cast<std::int64_t>(info.st_mtime) * 1'000'000'000,
+        .inode = static_cast<std::uint64_t>(info.st_ino),
+    };
+#else
+    auto ec = std::error_code{};
+    auto const status = follow ? fs::status(path, ec) : fs::symlink_status(path, ec);
+    if (ec) return std::unexpected(ec);
+    if (not fs::exists(status)) return std::unexpected(std::make_error_code(std::errc::no_such_file_or_directory));
+    auto result = file_status{
+        .type = fs::is_regular_file(status) ? file_type::file
+            : fs::is_directory(status) ? file_type::directory
+            : fs::is_symlink(status) ? file_type::symlink
+            : file_type::other,
+        .mode = static_cast<std::uint32_t>(status.permissions()),
+    };
+    if (result.type == file_type::file) result.size = fs::file_size(path, ec);
+    auto const time = std::chrono::clock_cast<std::chrono::system_clock>(fs::last_write_time(path, ec));
+    result.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    return result;
+#endif
+}
+static auto get_cache(lua_State* L) -> stat_cache* {
+    lua_getfield(L, LUA_REGISTRYINDEX, cache_key);
+    auto const cache = static_cast<stat_cache*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return cache;
+}
+static auto key_of(const fs::path& path) -> std::string {
+    auto ec = std::error_code{};
+    auto key = fs::absolute(path, ec).lexically_normal().generic_string();
+    if (key.size() > 1 and key.ends_with('/')) key.pop_back();
+    return key;
+}
+static auto slot_of(stat_cache::entry& entry, bool follow) -> std::optional<stat_result>& {
+    return follow ? entry.followed : entry.own;
+}
+auto lib::fs::cached_stat(lua_State* L, const path& path, bool follow) -> stat_result {
+    auto const cache = get_cache(L);
+    if (not cache) return stat_file(path, follow);
+    auto& slot = slot_of(cache->entries[key_of(path)], follow);
+    if (not slot) slot = stat_file(path, follow);
+    return *slot;
+}
+void lib::fs::invalidate_stat(lua_State* L, const path& path) {
+    auto const cache = get_cache(L);
+    if (not cache) return;
+    auto const key = key_of(path);
+    auto& entries = cache->entries;
+    entries.erase(key);
+    auto const below = key == "/" ? key : key + '/';
+    auto it = entries.lower_bound(below);
+    while (it != entries.end() and it->first.starts_with(below)) it = entries.erase(it);
+    entries.erase(fs::path{key}.parent_path().generic_string());
+}
+void lib::fs::reset_stat_cache(lua_State* L) {
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, cache_key);
+}
+auto lib::fs::type_name(lua_State* L, const path& path) -> const char* {
+    auto const own = cached_stat(L, path, false);
+    if (not own) return "unknown";
+    switch (own->type) {
+        case file_type::directory: return "directory";
+        case file_type::file: return "file";
+        case file_type::symlink: {
+            auto const target = cached_stat(L, path, true);
+            return target and target->type == file_type::directory ? "directory" : "symlink";
+        }
+        default: return "unknown";
+    }
+}
+static void push_status(lua_State* L, file_status const& status) {
+    lua_createtable(L, 0, 5);
+    lua_pushstring(L, file_type_names[static_cast<int>(status.type)]);
+    lua_setfield(L, -2, "type");
+    lua_pushnumber(L, static_cast<double>(status.size));
+    lua_setfield(L, -2, "size");
+    // exact to a few hundred nanoseconds as a double.
+    lua_pushnumber(L, static_cast<double>(status.mtime));
+    lua_setfield(L, -2, "mtime");
+    lua_pushnumber(L, static_cast<double>(status.mode));
+    lua_setfield(L, -2, "mode");
+    lua_pushnumber(L, static_cast<double>(status.inode));
+    lua_setfield(L, -2, "inode");
+}
+// the status table, or nil and the error message.
+static auto push_result(lua_State* L, stat_result const& result) -> int {
+    if (result) {
+        push_status(L, *result);
+        return 1;
+    }
+    lua_pushnil(L);
+    lua::push(L, result.error().message());
+    return 2;
+}
+auto lib::fs::stat(lua_State* L) -> int {
+    return push_result(L, cached_stat(L, to_path(L, 1), true));
+}
+auto lib::fs::lstat(lua_State* L) -> int {
+    return push_result(L, cached_stat(L, to_path(L, 1), false));
+}
+// cached results are answered right away, the rest is stat'ed on the pool
+// in one go. paths that fail are false in the result.
+auto lib::fs::statmany(lua_State* L) -> int {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    auto const follow = luaL_optboolean(L, 2, true);
+    auto const cache = get_cache(L);
+    auto paths = std::vector<path>{};
+    auto results = std::vector<std::optional<stat_result>>{};
+    for (int i{1}; lua_rawgeti(L, 1, i) != LUA_TNIL; ++i) {
+        paths.push_back(to_path(L, -1));
+        lua_pop(L, 1);
+        auto& result = results.emplace_back();
+        if (not cache) continue;
+        auto const found = cache->entries.find(key_of(paths.back()));
+        if (found != cache->entries.end()) result = slot_of(found->second, follow);
+    }
+    lua_pop(L, 1);
+    auto work = [paths = std::move(paths), results = std::move(results), follow]() mutable -> scheduler::continuation {
+        auto fresh = std::vector<bool>(results.size());
+        for (std::size_t i{}; i < results.size(); ++i) {
+            if (results[i]) continue;
+            results[i] = stat_file(paths[i], follow);
+            fresh[i] = true;
+        }
+        return [paths = std::move(paths), results = std::move(results), fresh = std::move(fresh), follow](lua_State* L) {
+            auto const cache = get_cache(L);
+            lua_createtable(L, static_cast<int>(results.size()), 0);
+            for (std::size_t i{}; i < results.size(); ++i) {
+                auto const& result = *results[i];
+                if (cache and fresh[i]) slot_of(cache->entries[key_of(paths[i])], follow) = result;
+                if (result) push_status(L, *result);
+                else lua_pushboolean(L, false);
+                lua_rawseti(L, -2, static_cast<int>(i + 1));
+            }
+            return 1;
+        };
+    };
+    return get_runtime(L).tasks.await(L, std::move(work));
+}
+// fs.statcache(enabled), returns whether the cache is on. turning it off
+// drops everything it held.
+auto lib::fs::statcache(lua_State* L) -> int {
+    if (lua_isnoneornil(L, 1)) return lua::push(L, get_cache(L) != nullptr);
+    auto const enable = luaL_checkboolean(L, 1);
+    if (not enable) reset_stat_cache(L);
+    else if (not get_cache(L)) {
+        lua::make_userdata<stat_cache>(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, cache_key);
+    }
+    return lua::push(L, enable);
+}
@@ -0,0 +1,485 @@
+#include "export.hpp"
+#include <export.hpp>
+#include "glob.hpp"
+#include "lua/lua.hpp"
+#include "runtime.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+namespace fs = std::filesystem;
+using namespace std::string_view_literals;
+
+// fs.walk, a parallel directory walk. every walk runs its own threads, each
+// with a deque of directories to scan that the others steal from when they
+// run dry. filters run on the walking threads and entries reach lua in
+// batches. directories the glob can not match below are not entered.
+namespace {
+enum class entry_type : unsigned char {
+    unknown,
+    file,
+    directory,
+    symlink,
+    other,
+};
+constexpr auto entry_type_names = std::to_array<const char*>({
+    "unknown",
+    "file",
+    "directory",
+    "symlink",
+    "other",
+});
+struct entry {
+    std::string path;
+    entry_type type;
+    std::uint64_t size;
+    // nanoseconds since the epoch.
+    std::int64_t mtime;
+};
+using batch = std::vector<entry>;
+struct walk_options {
+    std::string root;
+    std::vector<std::string> extensions;
+    std::optional<glob::pattern> glob;
+    int max_depth = INT_MAX;
+    entry_type type = entry_type::unknown;
+    std::string ignore_file;
+    bool hidden = true;
+    bool types = false;
+    bool stat = false;
+    bool packed = false;
+    std::size_t batch_size = 1024;
+    unsigned threads = std::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+};
+struct ignore_rule {
+    glob::pattern pattern;
+    bool anchored;
+    bool directory_only;
+    bool negated;
+};
+// rules of one ignore file, chained to the ignore files of the directories above.
+struct ignore_rules {
+    std::shared_ptr<ignore_rules const> parent;
+    // directory of the ignore file, relative to the root.
+    std::string base;
+    std::vector<ignore_rule> rules;
+};
+struct directory_task {
+    std::string relative;
+    int depth;
+    std::shared_ptr<ignore_rules const> ignore;
+};
+
+// gitignore style, blank lines and # comments are skipped, a leading !
+// negates, a trailing / only matches directories and a / anywhere else
+// anchors the pattern to the directory of the ignore file.
+auto parse_ignore(std::string_view text) -> std::vector<ignore_rule> {
+    auto rules = std::vector<ignore_rule>{};
+    while (not text.empty()) {
+        auto const end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == text.npos ? text.size() : end + 1);
+        while (not line.empty() and (line.back() == '\r' or line.back() == ' ')) line.remove_suffix(1);
+        if (line.empty() or line.front() == '#') continue;
+        auto rule = ignore_rule{};
+        if ((rule.negated = line.front() == '!')) line.remove_prefix(1);
+        if ((rule.directory_only = line.ends_with('/'))) line.remove_suffix(1);
+        rule.anchored = line.find('/') != line.npos;
+        if (line.starts_with('/')) line.remove_prefix(1);
+        auto compiled = glob::pattern::compile(line);
+        if (not compiled) continue;
+        rule.pattern = std::move(*compiled);
+        rules.push_back(std::move(rule));
+    }
+    return rules;
+}
+auto is_ignored(ignore_rules const* rules, std::string_view relative, bool directory) -> bool {
+    // outer ignore files first, so the closer ones get the last word.
+    auto chain = std::vector<ignore_rules const*>{};
+    for (; rules; rules = rules->parent.get()) chain.push_back(rules);
+    auto ignored = false;
+    for (auto const* r : chain | std::views::reverse) {
+        auto sub = relative;
+        if (not r->base.empty()) {
+            if (not sub.starts_with(r->base) or sub.size() <= r->base.size() or sub[r->base.size()] != '/') continue;
+            sub.remove_prefix(r->base.size() + 1);
+        }
+        auto const name = sub.substr(sub.rfind('/') + 1);
+        for (auto const& rule : r->rules) {
+            if (rule.directory_only and not directory) continue;
+            if (rule.pattern.match(rule.anchored ? sub : name)) ignored = not rule.negated;
+        }
+    }
+    return ignored;
+}
+
+class walker {
+public:
+    explicit walker(walk_options opts): opts_(std::move(opts)), queues_(opts_.threads) {
+        push(0, {.relative = {}, .depth = 0});
+        running_ = opts_.threads;
+        for (unsigned i{}; i < opts_.threads; ++i) {
+            threads_.emplace_back([this, i](std::stop_token stop) {work(i, stop);});
+        }
+    }
+    ~walker() {
+        for (auto& t : threads_) t.request_stop();
+        threads_.clear();
+    }
+    // the next batch, nullopt once the walk finished.
+    auto next() -> std::optional<batch> {
+        auto lock = std::unique_lock{out_mutex_};
+        out_ready_.wait(lock, [this] {return not out_.empty() or running_ == 0;});
+        if (out_.empty()) return std::nullopt;
+        auto b = std::move(out_.front());
+        out_.pop_front();
+        out_space_.notify_one();
+        return b;
+    }
+    auto options() const -> walk_options const& {return opts_;}
+private:
+    struct queue {
+        std::mutex mutex;
+        std::deque<directory_task> tasks;
+    };
+    // batches waiting for lua, walking pauses beyond this.
+    static constexpr std::size_t max_pending_batches = 64;
+
+    void push(std::size_t self, directory_task task) {
+        ++pending_;
+        {
+            auto lock = std::scoped_lock{queues_[self].mutex};
+            queues_[self].tasks.push_back(std::move(task));
+        }
+        ++queued_;
+        auto lock = std::scoped_lock{idle_mutex_};
+        idle_.notify_one();
+    }
+    // newest work from the own deque, the oldest from the others.
+    auto take(std::size_t self) -> std::optional<directory_task> {
+        for (std::size_t i{}; i < queues_.size(); ++i) {
+            auto& q = queues_[(self + i) % queues_.size()];
+            auto lock = std::scoped_lock{q.mutex};
+            if (q.tasks.empty()) continue;
+            auto task = std::optional<directory_task>{};
+            if (i == 0) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            --queued_;
+            return task;
+        }
+        return std::nullopt;
+    }
+    void work(std::size_t self, std::stop_token stop) {
+        auto local = batch{};
+        while (not stop.stop_requested()) {
+            if (auto task = take(self)) {
+                scan(self, *task, local, stop);
+                if (--pending_ == 0) {
+                    auto lock = std::scoped_lock{idle_mutex_};
+                    idle_.notify_all();
+                }
+                continue;
+            }
+            // hand out what was found before going idle.
+            if (not local.empty()) emit(local, stop);
+            auto lock = std::unique_lock{idle_mutex_};
+            idle_.wait(lock, stop, [this] {return queued_ > 0 or pending_ == 0;});
+            if (pending_ == 0) break;
+        }
+        if (not local.empty()) emit(local, stop);
+        auto lock = std::scoped_lock{out_mutex_};
+        if (--running_ == 0) out_ready_.notify_all();
+    }
+    void emit(batch& local, std::stop_token stop) {
+        auto lock = std::unique_lock{out_mutex_};
+        out_space_.wait(lock, stop, [this] {return out_.size() < max_pending_batches;});
+        if (stop.stop_requested()) return;
+        out_.push_back(std::exchange(local, {}));
+        out_ready_.notify_one();
+    }
+    auto wanted(std::string_view relative, entry_type type) const -> bool {
+        if (opts_.type != entry_type::unknown and opts_.type != type) return false;
+        if (not opts_.extensions.empty()) {
+            auto const name = relative.substr(relative.rfind('/') + 1);
+            auto const dot = name.rfind('.');
+            if (dot == name.npos or dot == 0) return false;
+            if (not std::ranges::contains(opts_.extensions, name.substr(dot))) return false;
+        }
+        return not opts_.glob or opts_.glob->match(relative);
+    }
+    // queues subdirectories and collects the wanted entries of one directory.
+    void visit(std::size_t self, directory_task const& task, std::string_view name, entry_type type,
+               std::shared_ptr<ignore_rules const> const& ignore, batch& local, std::stop_token stop, auto&& stat) {
+        if (name == "."sv or name == ".."sv) return;
+        if (not opts_.hidden and name.front() == '.') return;
+        auto relative = task.relative.empty() ? std::string{name} : std::format("{}/{}", task.relative, name);
+        auto const directory = type == entry_type::directory;
+        if (ignore and is_ignored(ignore.get(), relative, directory)) return;
+        auto const descend = not opts_.glob or opts_.glob->may_contain(relative);
+        if (directory and descend and task.depth + 1 < opts_.max_depth) {
+            push(self, {.relative = relative, .depth = task.depth + 1, .ignore = ignore});
+        }
+        if (not wanted(relative, type)) return;
+        auto e = entry{.path = std::format("{}/{}", opts_.root, relative), .type = type};
+        if (opts_.stat) stat(e);
+        local.push_back(std::move(e));
+        if (local.size() >= opts_.batch_size) emit(local, stop);
+    }
+    auto load_ignore(directory_task const& task, std::string_view contents) const -> std::shared_ptr<ignore_rules const> {
+        auto rules = parse_ignore(contents);
+        if (rules.empty()) return task.ignore;
+        return std::make_shared<ignore_rules const>(task.ignore, task.relative, std::move(rules));
+    }
+#ifdef __linux__
+    struct linux_dirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+    static auto read_at(int dir, const char* name) -> std::string {
+        auto const fd = ::openat(dir, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return {};
+        auto contents = std::string{};
+        auto chunk = std::array<char, 4096>{};
+        for (ssize_t n; (n = ::read(fd, chunk.data(), chunk.size())) > 0;) contents.append(chunk.data(), n);
+        ::close(fd);
+        return contents;
+    }
+    static auto to_entry_type(mode_t mode) -> entry_type {
+        if (S_ISREG(mode)) return entry_type::file;
+        if (S_ISDIR(mode)) return entry_type::directory;
+        if (S_ISLNK(mode)) return entry_type::symlink;
+        return entry_type::other;
+    }
+    // reads the directory with getdents64 in large chunks, the types come
+    // from d_type and stat is only called when the filesystem leaves it out.
+    void scan(std::size_t self, directory_task const& task, batch& local, std::stop_token stop) {
+        auto const path = task.relative.empty() ? opts_.root : std::format("{}/{}", opts_.root, task.relative);
+        auto const dir = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir < 0) return;
+        auto ignore = task.ignore;
+        if (not opts_.ignore_file.empty()) ignore = load_ignore(task, read_at(dir, opts_.ignore_file.c_str()));
+        alignas(linux_dirent64) char buffer[32 * 1024];
+        for (long size; (size = ::syscall(SYS_getdents64, dir, buffer, sizeof(buffer))) > 0;) {
+            for (long at{}; at < size;) {
+                auto const d = reinterpret_cast<linux_dirent64 const*>(buffer + at);
+                at += d->d_reclen;
+                auto type = entry_type::unknown;
+                switch (d->d_type) {
+                    case DT_REG: type = entry_type::file; break;
+                    case DT_DIR: type = entry_type::directory; break;
+                    case DT_LNK: type = entry_type::symlink; break;
+                    case DT_UNKNOWN: {
+                        struct stat info{};
+                        if (::fstatat(dir, d->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0) type = to_entry_type(info.st_mode);
+                        break;
+                    }
+                    default: type = entry_type::other;
+                }
+                visit(self, task, d->d_name, type, ignore, local, stop, [&](entry& e) {
+                    struct stat info{};
+                    if (::fstatat(dir, d->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) return;
+                    e.size = static_cast<std::uint64_t>(info.st_size);
+                    e.mtime = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1'000'000'000 + info.st_mtim.tv_nsec;
+                });
+            }
+        }
+        ::close(dir);
+    }
+#else
+    void scan(std::size_t self, directory_task const& task, batch& local, std::stop_token stop) {
+        auto const path = task.relative.empty() ? fs::path{opts_.root} : fs::path{opts_.root} / task.relative;
+        auto ignore = task.ignore;
+        if (not opts_.ignore_file.empty()) {
+            ignore = load_ignore(task, read_file(path / opts_.ignore_file).value_or(std::string{}));
+        }
+        auto ec = std::error_code{};
+        for (auto const& it : fs::directory_iterator{path, fs::directory_options::skip_permission_denied, ec}) {
+            auto const status = it.symlink_status(ec);
+            auto const type = fs::is_regular_file(status) ? entry_type::file
+                : fs::is_directory(status) ? entry_type::directory
+                : fs::is_symlink(status) ? entry_type::symlink
+                : entry_type::other;
+            visit(self, task, it.path().filename().string(), type, ignore, local, stop, [&](entry& e) {
+                auto ec = std::error_code{};
+                if (type == entry_type::file) e.size = it.file_size(ec);
+                auto const time = std::chrono::clock_cast<std::chrono::system_clock>(it.last_write_time(ec));
+                e.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+            });
+        }
+    }
+#endif
+    walk_options opts_;
+    std::vector<queue> queues_;
+    // directories queued or being scanned, the walk is over at zero.
+    std::atomic<std::size_t> pending_{};
+    std::atomic<std::size_t> queued_{};
+    std::mutex idle_mutex_;
+    std::condition_variable_any idle_;
+    std::mutex out_mutex_;
+    std::condition_variable out_ready_;
+    std::condition_variable_any out_space_;
+    std::deque<batch> out_;
+    unsigned running_ = 0;
+    std::vector<std::jthread> threads_;
+};
+using walker_handle = std::shared_ptr<walker>;
+
+// packed entries are [u8 type][u32 path size][path], followed by
+// [u64 size][i64 mtime in ns] when stat data was asked for.
+auto push_packed(lua_State* L, walk_options const& opts, batch const& b) -> int {
+    auto size = std::size_t{};
+    for (auto const& e : b) size += 5 + e.path.size() + (opts.stat ? 16 : 0);
+    auto out = static_cast<char*>(lua_newbuffer(L, size));
+    auto put = [&](auto const& v) {
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    };
+    for (auto const& e : b) {
+        put(static_cast<std::uint8_t>(e.type));
+        put(static_cast<std::uint32_t>(e.path.size()));
+        std::memcpy(out, e.path.data(), e.path.size());
+        out += e.path.size();
+        if (opts.stat) {
+            put(e.size);
+            put(e.mtime);
+        }
+    }
+    return 1;
+}
+// paths, then types, sizes and mtimes in seconds as parallel arrays when asked for.
+auto push_batch(lua_State* L, walk_options const& opts, batch const& b) -> int {
+    if (opts.packed) return push_packed(L, opts, b);
+    auto const n = static_cast<int>(b.size());
+    lua_createtable(L, n, 0);
+    for (int i{}; i < n; ++i) {
+        lua::push(L, b[i].path);
+        lua_rawseti(L, -2, i + 1);
+    }
+    auto results = 1;
+    if (opts.types) {
+        lua_createtable(L, n, 0);
+        for (int i{}; i < n; ++i) {
+            lua_pushstring(L, entry_type_names[static_cast<int>(b[i].type)]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        ++results;
+    }
+    if (opts.stat) {
+        lua_createtable(L, n, 0);
+        for (int i{}; i < n; ++i) {
+            lua_pushnumber(L, static_cast<double>(b[i].size));
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_createtable(L, n, 0);
+        for (int i{}; i < n; ++i) {
+            lua_pushnumber(L, static_cast<double>(b[i].mtime) / 1e9);
+            lua_rawseti(L, -2, i + 1);
+        }
+        results += 2;
+    }
+    return results;
+}
+auto walk_next(lua_State* L) -> int {
+    auto self = lua::to_userdata<walker_handle>(L, lua_upvalueindex(1));
+    return get_runtime(L).tasks.await(L, [self]() -> scheduler::continuation {
+        auto b = self->next();
+        if (not b) return [](lua_State*) -> int {return lua::none;};
+        return [self, b = std::move(*b)](lua_State* L) {return push_batch(L, self->options(), b);};
+    });
+}
+auto optional_field(lua_State* L, int idx, const char* name, int type) -> bool {
+    lua_getfield(L, idx, name);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return false;
+    }
+    if (lua_type(L, -1) != type) luaL_errorL(L, "option '%s' must be a %s", name, lua_typename(L, type));
+    return true;
+}
+auto to_walk_options(lua_State* L, int idx) -> walk_options {
+    auto opts = walk_options{};
+    if (lua_isnoneornil(L, idx)) return opts;
+    luaL_checktype(L, idx, LUA_TTABLE);
+    auto add_extension = [&](std::string_view ext) {
+        opts.extensions.push_back(ext.starts_with('.') ? std::string{ext} : std::format(".{}", ext));
+    };
+    lua_getfield(L, idx, "extensions");
+    if (lua_isstring(L, -1)) {
+        add_extension(lua_tostring(L, -1));
+    } else if (lua_istable(L, -1)) {
+        for (int i{1}; lua_rawgeti(L, -1, i) == LUA_TSTRING; ++i) {
+            add_extension(lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "glob");
+    if (not lua_isnil(L, -1)) opts.glob = lib::fs::to_globpattern(L, -1);
+    lua_pop(L, 1);
+    if (optional_field(L, idx, "ignore", LUA_TSTRING)) opts.ignore_file = lua_tostring(L, -1), lua_pop(L, 1);
+    if (optional_field(L, idx, "maxdepth", LUA_TNUMBER)) opts.max_depth = std::max(1, lua_tointeger(L, -1)), lua_pop(L, 1);
+    if (optional_field(L, idx, "batch", LUA_TNUMBER)) opts.batch_size = std::max(1, lua_tointeger(L, -1)), lua_pop(L, 1);
+    if (optional_field(L, idx, "threads", LUA_TNUMBER)) opts.threads = std::clamp(lua_tointeger(L, -1), 1, 64), lua_pop(L, 1);
+    if (optional_field(L, idx, "hidden", LUA_TBOOLEAN)) opts.hidden = lua_toboolean(L, -1), lua_pop(L, 1);
+    if (optional_field(L, idx, "types", LUA_TBOOLEAN)) opts.types = lua_toboolean(L, -1), lua_pop(L, 1);
+    if (optional_field(L, idx, "stat", LUA_TBOOLEAN)) opts.stat = lua_toboolean(L, -1), lua_pop(L, 1);
+    if (optional_field(L, idx, "format", LUA_TSTRING)) {
+        std::string_view const format = lua_tostring(L, -1);
+        if (format != "table" and format != "buffer") luaL_errorL(L, "option 'format' must be 'table' or 'buffer'");
+        opts.packed = format == "buffer";
+        lua_pop(L, 1);
+    }
+    if (optional_field(L, idx, "type", LUA_TSTRING)) {
+        std::string_view const type = lua_tostring(L, -1);
+        auto const found = std::ranges::find(entry_type_names, type);
+        if (found == entry_type_names.end() or found == entry_type_names.begin()) {
+            luaL_errorL(L, "option 'type' must be 'file', 'directory', 'symlink' or 'other'");
+        }
+        opts.type = static_cast<entry_type>(found - entry_type_names.begin());
+        lua_pop(L, 1);
+    }
+    return opts;
+}
+}
+auto lib::fs::walk(lua_State* L) -> int {
+    auto const root = to_path(L, 1);
+    if (not std::filesystem::is_directory(root)) {
+        luaL_errorL(L, "path '%s' must be a directory", root.string().c_str());
+    }
+    auto opts = to_walk_options(L, 2);
+    opts.root = root.generic_string();
+    while (opts.root.size() > 1 and opts.root.ends_with('/')) opts.root.pop_back();
+    lua::make_userdata<walker_handle>(L, std::make_shared<walker>(std::move(opts)));
+    lua::push_cclosure(L, walk_next, "walk_iterator", 1);
+    return 1;
+}
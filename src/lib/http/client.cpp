@@ -2,61 +2,75 @@
 #include "named_atom.hpp"
 #include "lua/lua.hpp"
 #include "lua/typeutility.hpp"
+#include "runtime.hpp"
 using state = lua_State*;
 using self = lib::http::client;
 using props = lua::properties<self>;
 using type = lua::type<self>;
 using response_type = lua::type<lib::http::response>;
 
+static constexpr auto methods = lua::method_table<self, named_atom>{
+    {named_atom::get, [](state L, self& self) -> int {
+        // self stays pinned on the yielded thread while the request runs.
+        auto path = std::string{luaL_checkstring(L, 2)};
+        return get_runtime(L).tasks.await(L, [&self, path = std::move(path)]() -> scheduler::continuation {
+            auto r = [&] {
+                auto lock = std::scoped_lock{self.mutex};
+                return self.Get(path);
+            }();
+            if (!r) return [error = static_cast<int>(r.error())](state L) {
+                return lua::push_tuple(L, lua::nil, std::format("error occurred ({})", error));
+            };
+            return [response = std::move(*r)](state L) mutable {
+                response_type::make(L, std::move(response));
+                return 1;
+            };
+        });
+    }},
+    {named_atom::stop, [](state L, self& self) -> int {
+        // not locked, stopping is how a running request is aborted.
+        self.stop();
+        return lua::none;
+    }},
+};
 TYPE_CONFIG (lib::http::client) {
     .type = "httpclient",
     .on_setup = [](state L) {
-        props::add("host", [](state L, const self& self) {
+        props::add(L, "host", [](state L, const self& self) {
             return lua::push(L, self.host());
         });
-        props::add("isvalid", [](state L, const self& self) {
+        props::add(L, "isvalid", [](state L, const self& self) {
             return lua::push(L, self.is_valid());
         });
-        props::add("port", [](state L, const self& self) {
+        props::add(L, "port", [](state L, const self& self) {
             return lua::push(L, self.port());
         });
-        props::add("encodeurl", nullptr, [](state L, self& self) {
+        props::add(L, "encodeurl", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_url_encode(luaL_checkboolean(L, 2));
         });
-        props::add("keepalive", nullptr, [](state L, self& self) {
+        props::add(L, "keepalive", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_keep_alive(luaL_checkboolean(L, 2));
         });
-        props::add("connectiontimeout", nullptr, [](state L, self& self) {
+        props::add(L, "connectiontimeout", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_connection_timeout(std::chrono::milliseconds(luaL_checkinteger(L, 2)));
         });
-        props::add("maxtimeout", nullptr, [](state L, self& self) {
+        props::add(L, "maxtimeout", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_max_timeout(std::chrono::milliseconds(luaL_checkinteger(L, 2)));
         });
-        props::add("readtimeout", nullptr, [](state L, self& self) {
+        props::add(L, "readtimeout", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_read_timeout(std::chrono::milliseconds(luaL_checkinteger(L, 2)));
         });
-        props::add("writetimeout", nullptr, [](state L, self& self) {
+        props::add(L, "writetimeout", nullptr, [](state L, self& self) {
+            auto lock = std::scoped_lock{self.mutex};
             self.set_write_timeout(std::chrono::milliseconds(luaL_checkinteger(L, 2)));
         });
     },
-    .namecall = [](state L) -> int {
-        auto& self = type::to(L, 1);
-        auto [atom, name] = lua::namecall_atom<named_atom>(L);
-        switch (atom) {
-            case named_atom::get: {
-                auto r = self.Get(luaL_checkstring(L, 2));
-                if (!r) return lua::push_tuple(L, lua::nil, std::format("error occurred ({})", static_cast<int>(r.error())));
-                response_type::make(L, std::move(*r));
-                return 1;
-            }
-            case named_atom::stop:
-                self.stop();
-                return lua::none;
-            default:
-                luaL_errorL(L, "invalid namecall %s", name);
-        }
-        luaL_errorL(L, "invalid namecall %s", name);
-    },
+    .namecall = lua::namecall<self, methods>,
     .index = props::index,
     .newindex = props::newindex,
 };
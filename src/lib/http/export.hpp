@@ -1,9 +1,15 @@
 #pragma once
 #include <httplib.h>
+#include <mutex>
 struct lua_State;
 
 namespace lib::http {
-using client = httplib::Client;
+// httplib clients are not thread safe, requests offloaded to the pool and
+// changes to the settings are serialized through the mutex.
+struct client : httplib::Client {
+    using httplib::Client::Client;
+    std::mutex mutex;
+};
 using response = httplib::Response;
 void library(lua_State* L, int idx);
 }
@@ -6,7 +6,10 @@
 #include <expected>
 #include <regex>
 #include "lua/typeutility.hpp"
+#include "runtime.hpp"
+#include <optional>
 using state = lua_State*;
+using continuation = scheduler::continuation;
 
 struct parsed_url {
     std::string scheme;
@@ -50,11 +53,17 @@ static auto urlinfo(state L) -> int {
 static auto get(lua_State* L) -> int {
     auto parsed = parse_url(luaL_checkstring(L, 1));
     if (not parsed) luaL_errorL(L, parsed.error());
-    auto client = httplib::Client{parsed->host_port()};
-    auto r = client.Get(parsed->path);
-    if (!r) return lua::push_tuple(L, lua::nil, std::format("error occurred ({})", static_cast<int>(r.error())));
-    lua::type<lib::http::response>::make(L, std::move(*r));
-    return 1;
+    return get_runtime(L).tasks.await(L, [url = std::move(*parsed)]() mutable -> continuation {
+        auto client = httplib::Client{url.host_port()};
+        auto r = client.Get(url.path);
+        if (!r) return [error = static_cast<int>(r.error())](lua_State* L) {
+            return lua::push_tuple(L, lua::nil, std::format("error occurred ({})", error));
+        };
+        return [response = std::move(*r)](lua_State* L) mutable {
+            lua::type<lib::http::response>::make(L, std::move(response));
+            return 1;
+        };
+    });
 }
 static auto client(lua_State* L) -> int {
     lua::type<lib::http::client>::make(L, luaL_checkstring(L, 1));
@@ -63,32 +72,36 @@ static auto client(lua_State* L) -> int {
 static auto post(lua_State* L) -> int {
     auto parsed = parse_url(luaL_checkstring(L, 1));
     if (not parsed) luaL_errorL(L, parsed.error());
-    auto client = httplib::Client{parsed->host_port()};
 
-    std::string body{};
-    httplib::Result result{};
+    // the table is serialized on the calling thread, the request itself is offloaded.
+    std::optional<std::string> body{};
     switch (lua_type(L, 2)) {
         case LUA_TTABLE:
-            result = client.Post(
-                parsed->path,
-                lua::json::table_to_json(L, 2),
-                "application/json"
-            );
+            body = lua::json::table_to_json(L, 2).dump();
+            break;
         case LUA_TNIL:
         case LUA_TNONE:
-            result = client.Post(parsed->path);
             break;
         default:
             luaL_argerrorL(L, 2, nullptr);
     }
-    if (result) {
-        lua::push(L, result->status);
-        if (not result->body.empty()) {
-            lua::json::push_json_as_table(L, result->body);
-        }
-        return 2;
-    }
-    return lua::push_tuple(L, lua::nil, "request failed");
+    return get_runtime(L).tasks.await(L, [url = std::move(*parsed), body = std::move(body)]() mutable -> continuation {
+        auto client = httplib::Client{url.host_port()};
+        auto result = body
+            ? client.Post(url.path, *body, "application/json")
+            : client.Post(url.path);
+        if (not result) return [](lua_State* L) {
+            return lua::push_tuple(L, lua::nil, "request failed");
+        };
+        auto json = std::optional<nlohmann::json>{};
+        if (not result->body.empty()) json = nlohmann::json::parse(result->body);
+        return [status = result->status, json = std::move(json)](lua_State* L) {
+            lua::push(L, status);
+            if (not json) return 1;
+            lua::json::push_value(L, *json);
+            return 2;
+        };
+    });
 }
 void lib::http::library(lua_State* L, int idx) {
     lua::set_functions(L, idx, std::to_array<luaL_Reg>({
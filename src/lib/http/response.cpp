@@ -8,47 +8,41 @@ using self = lib::http::response;
 using props = lua::properties<self>;
 using type = lua::type<self>;
 
+static constexpr auto methods = lua::method_table<self, named_atom>{
+    {named_t::getheaders, [](state L, self& self) -> int {
+        lua_newtable(L);
+        for (const auto& [key, header] : self.headers) {
+            lua::set_field(L, key, header);
+        }
+        return 1;
+    }},
+    {named_t::getheadervalue, [](state L, self& self) -> int {
+        return lua::push(L, self.get_header_value(
+            luaL_checkstring(L, 2),
+            luaL_optstring(L, 3, "")
+        ));
+    }},
+};
 TYPE_CONFIG (lib::http::response) {
     .type = "httpresponse",
     .on_setup = [](lua_State* L) {
-        props::add("body", [](state L, const self& self) {
+        props::add(L, "body", [](state L, const self& self) {
             return lua::push(L, self.body);
         });
-        props::add("status", [](state L, const self& self) {
+        props::add(L, "status", [](state L, const self& self) {
             return lua::push(L, self.status);
         });
-        props::add("location", [](state L, const self& self) {
+        props::add(L, "location", [](state L, const self& self) {
             return lua::push(L, self.location);
         });
-        props::add("version", [](state L, const self& self) {
+        props::add(L, "version", [](state L, const self& self) {
             return lua::push(L, self.version);
         });
-        props::add("reason", [](state L, const self& self) {
+        props::add(L, "reason", [](state L, const self& self) {
             return lua::push(L, self.reason);
         });
     },
-    .namecall = [](lua_State* L) -> int {
-        auto& self = type::to(L, 1);
-        auto [atom, name] = lua::namecall_atom<named_atom>(L);
-        switch (atom) {
-            case named_t::getheaders:
-                lua_newtable(L);
-                for(const auto& [key, header] : self.headers) {
-                    lua::set_field(L, key, header);
-                }
-                return 1;
-            case named_t::getheadervalue: {
-                auto def = luaL_optstring(L, 3, "");
-                auto v = self.get_header_value(
-                    luaL_checkstring(L, 2),
-                    luaL_optstring(L, 3, "")
-                );
-                return lua::push(L, v);
-            }
-            default:
-                luaL_errorL(L, "invalid namecall '%s'", name);
-        }
-    },
+    .namecall = lua::namecall<self, methods>,
     .index = props::index,
     .newindex = props::newindex,
 };
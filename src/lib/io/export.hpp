@@ -1,6 +1,12 @@
 #pragma once
+#include <cstddef>
+#include <expected>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <span>
+#include <string>
 #include <variant>
 struct lua_State;
 
@@ -33,5 +39,36 @@ using writer = interface<std::ostream>;
 using reader = interface<std::istream>;
 using filewriter = std::ofstream;
 using filereader = std::ifstream;
+// read only view of a whole file, mapped instead of read so that large
+// files are never copied into the state. the pages are loaded on access.
+class mapped_file {
+public:
+    enum class advice {
+        normal,
+        sequential,
+        random,
+        willneed,
+    };
+    static auto open(std::filesystem::path const& path, advice hint) -> std::expected<std::shared_ptr<mapped_file>, std::string>;
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+    ~mapped_file();
+    auto bytes() const -> std::span<const std::byte> {return {data_, size_};}
+    auto is_open() const -> bool {return open_;}
+    // a hint for the pages of the view, ignored where it is not supported.
+    void advise(advice hint);
+    // unmaps the view, it is empty afterwards.
+    void close();
+private:
+    mapped_file() = default;
+    const std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    // windows reads the file into memory instead.
+    std::unique_ptr<std::byte[]> copy_;
+#endif
+};
+using mapped_file_handle = std::shared_ptr<mapped_file>;
 void library(lua_State* L, int idx);
 }
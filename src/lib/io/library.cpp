@@ -2,12 +2,19 @@
 #include "lib/fs/export.hpp"
 #include "lua/lua.hpp"
 #include "lua/typeutility.hpp"
+#include "runtime.hpp"
+#include <export.hpp>
 #include <iostream>
 #include <filesystem>
+#include <format>
+#include <string_view>
+#include <utility>
 using lib::io::writer;
 using lib::io::reader;
 using lib::io::filereader;
 using lib::io::filewriter;
+using lib::io::mapped_file;
+using lib::io::mapped_file_handle;
 static auto scan(lua_State* L) -> int {
     auto str = std::string{};
     std::cin >> str;
@@ -39,6 +46,8 @@ static auto push_open_filewriter(lua_State* L, std::filesystem::path const& path
 static auto filewriter_create(lua_State* L) -> int {
     auto path = lib::fs::to_path(L, 1);
     auto append_mode = luaL_optboolean(L, 2, false);
+    // opening creates or truncates the file.
+    lib::fs::invalidate_stat(L, path);
     return push_open_filewriter(L, path, append_mode);
 }
 static auto filereader_create(lua_State* L) -> int {
@@ -46,15 +55,110 @@ static auto filereader_create(lua_State* L) -> int {
     check_open(L, path, lua::type<filereader>::make(L, std::ifstream{path}));
     return 1;
 }
+static auto push_failure(lua_State* L, std::string_view message) -> int {
+    lua_pushnil(L);
+    lua::push(L, message);
+    return 2;
+}
+static auto to_advice(std::string_view hint) -> mapped_file::advice {
+    if (hint == "random") return mapped_file::advice::random;
+    if (hint == "willneed") return mapped_file::advice::willneed;
+    if (hint == "normal") return mapped_file::advice::normal;
+    return mapped_file::advice::sequential;
+}
+// registry reference to the value on top of the stack. only ever dropped on
+// the thread of the state, offloaded work hands it on to its continuation.
+struct registry_pin {
+    lua_State* main;
+    int ref;
+    explicit registry_pin(lua_State* L): main(lua_mainthread(L)), ref(lua_ref(L, -1)) {}
+    registry_pin(registry_pin&& other) noexcept: main(other.main), ref(std::exchange(other.ref, LUA_NOREF)) {}
+    registry_pin& operator=(registry_pin&&) = delete;
+    ~registry_pin() {if (ref != LUA_NOREF) lua_unref(main, ref);}
+};
+// io.readfile(path, {mode, advice}). string mode is the plain read, buffer
+// mode reads straight into a new buffer and mmap mode maps the file without
+// reading it at all. failures return nil and a message.
+static auto readfile(lua_State* L) -> int {
+    auto path = lib::fs::to_path(L, 1);
+    auto mode = std::string_view{"string"};
+    auto advice = std::string_view{"sequential"};
+    if (lua_istable(L, 2)) {
+        // the option strings stay alive in the table.
+        lua_getfield(L, 2, "mode");
+        if (lua_isstring(L, -1)) mode = lua_tostring(L, -1);
+        lua_getfield(L, 2, "advice");
+        if (lua_isstring(L, -1)) advice = lua_tostring(L, -1);
+        lua_pop(L, 2);
+    }
+    if (mode == "mmap") {
+        auto file = mapped_file::open(path, to_advice(advice));
+        if (not file) return push_failure(L, file.error());
+        lua::type<mapped_file_handle>::make(L, std::move(*file));
+        return 1;
+    }
+    if (mode == "buffer") {
+        auto ec = std::error_code{};
+        auto const size = std::filesystem::file_size(path, ec);
+        if (ec) return push_failure(L, ec.message());
+        auto const data = lua::make_buffer(L, size);
+        // stack slots are out of reach once the thread yielded, the pin
+        // travels with the continuation so a cancelled read releases it too.
+        auto pin = registry_pin{L};
+        return get_runtime(L).tasks.await(L, [path = std::move(path), data, pin = std::move(pin)]() mutable -> scheduler::continuation {
+            auto file = std::ifstream{path, std::ios::binary};
+            auto const ok = file and file.read(data.data(), data.size());
+            return [ok, path = std::move(path), pin = std::move(pin)](lua_State* L) {
+                if (not ok) return push_failure(L, std::format("failed to read '{}'", path.string()));
+                lua_getref(L, pin.ref);
+                return 1;
+            };
+        });
+    }
+    if (mode != "string") luaL_argerrorL(L, 2, "mode must be 'string', 'buffer' or 'mmap'");
+    return get_runtime(L).tasks.await(L, [path = std::move(path)]() -> scheduler::continuation {
+        auto contents = read_file(path);
+        if (not contents) {
+            auto const reason = contents.error() == read_file_error::not_a_file ? "is not a file" : "could not be read";
+            return [message = std::format("'{}' {}", path.string(), reason)](lua_State* L) {return push_failure(L, message);};
+        }
+        return [contents = std::move(*contents)](lua_State* L) {return lua::push(L, std::string_view{contents});};
+    });
+}
+// io.writefile(path, data, append), data is a string or a buffer that is
+// written from where it lives in the state.
+static auto writefile(lua_State* L) -> int {
+    auto path = lib::fs::to_path(L, 1);
+    auto data = std::span<const char>{};
+    if (lua_isbuffer(L, 2)) {
+        data = lua::to_buffer(L, 2);
+    } else {
+        auto size = size_t{};
+        auto const string = luaL_checklstring(L, 2, &size);
+        data = {string, size};
+    }
+    auto const append = luaL_optboolean(L, 3, false);
+    return get_runtime(L).tasks.await(L, [path = std::move(path), data, append]() -> scheduler::continuation {
+        auto file = std::ofstream{path, std::ios::binary | (append ? std::ios::app : std::ios::trunc)};
+        auto const ok = file and file.write(data.data(), data.size()) and file.flush();
+        return [ok, path](lua_State* L) {
+            lib::fs::invalidate_stat(L, path);
+            return lua::push(L, static_cast<bool>(ok));
+        };
+    });
+}
 void lib::io::library(lua_State* L, int idx) {
     lua::set_functions(L, idx, std::to_array<luaL_Reg>({
         {"filewriter", filewriter_create},
         {"filereader", filereader_create},
+        {"readfile", readfile},
+        {"writefile", writefile},
     }));
-    lua::type<writer>::make(L, std::cout);
+    auto& rt = get_runtime(L);
+    lua::type<writer>::make(L, *rt.out);
     lua_setfield(L, idx, "stdout");
-    lua::type<writer>::make(L, std::cerr);
+    lua::type<writer>::make(L, *rt.err);
     lua_setfield(L, idx, "stderr");
-    lua::type<reader>::make(L, std::cin);
+    lua::type<reader>::make(L, *rt.in);
     lua_setfield(L, idx, "stdin");
 }
@@ -0,0 +1,201 @@
+#include "export.hpp"
+#include "named_atom.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <string_view>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using lib::io::mapped_file;
+using lib::io::mapped_file_handle;
+using type = lua::type<mapped_file_handle>;
+
+auto mapped_file::open(std::filesystem::path const& path, advice hint) -> std::expected<std::shared_ptr<mapped_file>, std::string> {
+    auto self = std::shared_ptr<mapped_file>{new mapped_file{}};
+#ifdef _WIN32
+    auto file = std::ifstream{path, std::ios::binary | std::ios::ate};
+    if (not file) return std::unexpected(std::format("failed to open '{}'", path.string()));
+    self->size_ = static_cast<std::size_t>(file.tellg());
+    self->copy_ = std::make_unique<std::byte[]>(self->size_);
+    file.seekg(0);
+    if (not file.read(reinterpret_cast<char*>(self->copy_.get()), self->size_)) {
+        return std::unexpected(std::format("failed to read '{}'", path.string()));
+    }
+    self->data_ = self->copy_.get();
+#else
+    auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::unexpected(std::format("failed to open '{}': {}", path.string(), std::strerror(errno)));
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 or not S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return std::unexpected(std::format("'{}' is not a file", path.string()));
+    }
+    self->size_ = static_cast<std::size_t>(info.st_size);
+    // empty files can not be mapped, the view just stays empty.
+    if (self->size_ > 0) {
+        auto const data = ::mmap(nullptr, self->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            return std::unexpected(std::format("failed to map '{}': {}", path.string(), std::strerror(errno)));
+        }
+        self->data_ = static_cast<const std::byte*>(data);
+    }
+    // the mapping keeps the file referenced on its own.
+    ::close(fd);
+#endif
+    self->open_ = true;
+    self->advise(hint);
+    return self;
+}
+void mapped_file::advise(advice hint) {
+#ifndef _WIN32
+    if (not data_) return;
+    auto const flag = hint == advice::sequential ? MADV_SEQUENTIAL
+        : hint == advice::random ? MADV_RANDOM
+        : hint == advice::willneed ? MADV_WILLNEED
+        : MADV_NORMAL;
+    ::madvise(const_cast<std::byte*>(data_), size_, flag);
+#endif
+}
+void mapped_file::close() {
+#ifdef _WIN32
+    copy_.reset();
+#else
+    if (data_) ::munmap(const_cast<std::byte*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+mapped_file::~mapped_file() {
+    close();
+}
+
+static auto check_open(lua_State* L, mapped_file const& self) -> std::span<const std::byte> {
+    if (not self.is_open()) luaL_errorL(L, "mapped file is closed");
+    return self.bytes();
+}
+// the count bytes at the zero based offset, like the buffer library.
+static auto range_of(lua_State* L, mapped_file const& self, int offset_idx, std::size_t count) -> std::span<const std::byte> {
+    auto const bytes = check_open(L, self);
+    auto const offset = luaL_checknumber(L, offset_idx);
+    if (offset < 0 or offset + count > bytes.size()) luaL_errorL(L, "mapped file access out of bounds");
+    return bytes.subspan(static_cast<std::size_t>(offset), count);
+}
+template <typename T>
+static auto read(lua_State* L, mapped_file_handle& self) -> int {
+    auto arr = std::array<std::byte, sizeof(T)>{};
+    std::ranges::copy(range_of(L, *self, 2, sizeof(T)), arr.begin());
+    return lua::push(L, static_cast<double>(std::bit_cast<T>(arr)));
+}
+static auto as_string(std::span<const std::byte> bytes) -> std::string_view {
+    return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+// offset at 2 and count at 3, both optional and clamped to the view.
+static auto optional_range(lua_State* L, mapped_file const& self, int idx) -> std::span<const std::byte> {
+    auto const bytes = check_open(L, self);
+    auto const offset = static_cast<std::size_t>(std::clamp<double>(luaL_optnumber(L, idx, 0), 0, bytes.size()));
+    auto const count = std::clamp<double>(luaL_optnumber(L, idx + 1, bytes.size() - offset), 0, bytes.size() - offset);
+    return bytes.subspan(offset, static_cast<std::size_t>(count));
+}
+struct line_cursor {
+    mapped_file_handle file;
+    std::size_t position;
+};
+// lines without their newline, straight from the mapped pages.
+static auto line_iterator_closure(lua_State* L) -> int {
+    auto& cursor = lua::to_userdata<line_cursor>(L, lua_upvalueindex(1));
+    auto const text = as_string(check_open(L, *cursor.file));
+    if (cursor.position >= text.size()) return lua::none;
+    auto const end = std::min(text.find('\n', cursor.position), text.size());
+    lua::push(L, text.substr(cursor.position, end - cursor.position));
+    cursor.position = end + 1;
+    return 1;
+}
+static auto to_advice(lua_State* L, int idx) -> mapped_file::advice {
+    std::string_view const hint = luaL_checkstring(L, idx);
+    if (hint == "sequential") return mapped_file::advice::sequential;
+    if (hint == "random") return mapped_file::advice::random;
+    if (hint == "willneed") return mapped_file::advice::willneed;
+    if (hint == "normal") return mapped_file::advice::normal;
+    luaL_argerrorL(L, idx, "expected 'sequential', 'random', 'willneed' or 'normal'");
+}
+static constexpr auto methods = lua::method_table<mapped_file_handle, named_atom>{
+    {named_atom::readu8, read<std::uint8_t>},
+    {named_atom::readi8, read<std::int8_t>},
+    {named_atom::readu16, read<std::uint16_t>},
+    {named_atom::readi16, read<std::int16_t>},
+    {named_atom::readu32, read<std::uint32_t>},
+    {named_atom::readi32, read<std::int32_t>},
+    {named_atom::readf32, read<float>},
+    {named_atom::readf64, read<double>},
+    {named_atom::readstring, [](lua_State* L, mapped_file_handle& self) -> int {
+        auto const count = luaL_checknumber(L, 3);
+        if (count < 0) luaL_argerrorL(L, 3, "count must not be negative");
+        return lua::push(L, as_string(range_of(L, *self, 2, static_cast<std::size_t>(count))));
+    }},
+    {named_atom::slice, [](lua_State* L, mapped_file_handle& self) -> int {
+        lua::make_buffer(L, optional_range(L, *self, 2));
+        return 1;
+    }},
+    // copy(target, targetoffset, offset, count) copies into a buffer and
+    // returns the number of bytes copied.
+    {named_atom::copy, [](lua_State* L, mapped_file_handle& self) -> int {
+        auto size = size_t{};
+        auto const target = static_cast<std::byte*>(luaL_checkbuffer(L, 2, &size));
+        auto const target_offset = luaL_optinteger(L, 3, 0);
+        if (target_offset < 0 or static_cast<size_t>(target_offset) > size) luaL_argerrorL(L, 3, "offset out of range");
+        auto const source = optional_range(L, *self, 4);
+        auto const count = std::min(source.size(), size - target_offset);
+        std::memcpy(target + target_offset, source.data(), count);
+        return lua::push(L, static_cast<double>(count));
+    }},
+    {named_atom::indexof, [](lua_State* L, mapped_file_handle& self) -> int {
+        auto const text = as_string(check_open(L, *self));
+        auto size = size_t{};
+        auto const needle = luaL_checklstring(L, 2, &size);
+        auto const found = text.find({needle, size}, static_cast<std::size_t>(std::max(0.0, luaL_optnumber(L, 3, 0))));
+        if (found == text.npos) return lua::push(L, lua::nil);
+        return lua::push(L, static_cast<double>(found));
+    }},
+    {named_atom::lines, [](lua_State* L, mapped_file_handle& self) -> int {
+        check_open(L, *self);
+        lua::make_userdata<line_cursor>(L, self, std::size_t{});
+        lua::push_cclosure(L, line_iterator_closure, "mapped_line_iterator", 1);
+        return 1;
+    }},
+    {named_atom::advise, [](lua_State* L, mapped_file_handle& self) -> int {
+        check_open(L, *self);
+        self->advise(to_advice(L, 2));
+        return lua::none;
+    }},
+    {named_atom::close, [](lua_State* L, mapped_file_handle& self) -> int {
+        self->close();
+        return lua::none;
+    }},
+};
+TYPE_CONFIG (mapped_file_handle) {
+    .type = "mappedfile",
+    .on_setup = [](lua_State* L) {
+        using props = lua::properties<mapped_file_handle>;
+        props::add(L, "size", [](lua_State* L, mapped_file_handle const& self) {
+            return lua::push(L, static_cast<double>(self->bytes().size()));
+        });
+        props::add(L, "isopen", [](lua_State* L, mapped_file_handle const& self) {
+            return lua::push(L, self->is_open());
+        });
+    },
+    .namecall = lua::namecall<mapped_file_handle, methods>,
+    .index = lua::properties<mapped_file_handle>::index,
+};
@@ -2,130 +2,149 @@
 #include "named_atom.hpp"
 #include "lua/lua.hpp"
 #include "lua/typeutility.hpp"
+#include "runtime.hpp"
 #include <bit>
 using lib::io::reader;
 using lib::io::writer;
 using lib::io::filewriter;
 using lib::io::filereader;
 
-template<typename T>
-static auto read(reader& from, lua_State* L, int idx = 2) -> int {
+// the method tables are shared between the stream interfaces and the file
+// streams, which are held by value.
+static auto stream(writer& self) -> std::ostream& {return *self;}
+static auto stream(reader& self) -> std::istream& {return *self;}
+static auto stream(std::ostream& self) -> std::ostream& {return self;}
+static auto stream(std::istream& self) -> std::istream& {return self;}
+
+template <typename T, typename Reader>
+static auto read(lua_State* L, Reader& self) -> int {
     auto arr = std::array<char, sizeof(T)>{};
-    from->read(arr.data(), arr.size());
+    stream(self).read(arr.data(), arr.size());
     return lua::push(L, static_cast<double>(std::bit_cast<T>(arr)));
-};
+}
 static auto line_iterator_closure(lua_State* L) -> int {
     auto& self = lua::type<reader>::to(L, lua_upvalueindex(1));
     std::string line;
     if (std::getline(*self, line)) return lua::push(L, line);
     else return lua::none; 
 }
-template<typename U>
-static auto write_number_raw(writer& to, lua_State* L, int idx = 2) -> size_t {
-    auto data = static_cast<U>(luaL_checknumber(L, idx));
+template <typename U, typename Writer>
+static auto write_number(lua_State* L, Writer& self) -> int {
+    auto data = static_cast<U>(luaL_checknumber(L, 2));
     auto bytes = std::bit_cast<std::array<uint8_t, sizeof(U)>>(data);
-    for (auto byte : bytes) to->put(byte);
-    return sizeof(U);
-};
-static auto reader_namecall(lua_State *L, reader& self, named_atom atom) -> std::optional<int> {
-    using named = named_atom;
-    switch (static_cast<named>(atom)) {
-        case named::readu8: return read<uint8_t>(self, L);
-        case named::readi8: return read<int8_t>(self, L);
-        case named::readu16: return read<uint16_t>(self, L);
-        case named::readi16: return read<int16_t>(self, L);
-        case named::readu32: return read<uint32_t>(self, L);
-        case named::readi32: return read<int32_t>(self, L);
-        case named::readf32: return read<float>(self, L);
-        case named::readf64: return read<double>(self, L);
-        case named::scan: {
-            std::string str{};
-            *self >> str; 
-            return lua::push(L, str);
-        }
-        case named::lines: {
-            lua::type<reader>::make(L, reader{*self});
-            lua_pushcclosure(L, line_iterator_closure, "line_iterator", 1);
-            return 1;
-        }
-        default:
-            return std::nullopt;
-    }
+    for (auto byte : bytes) stream(self).put(byte);
+    lua_pushvalue(L, 1);
+    return 1;
 }
-auto writer_namecall(lua_State* L, writer& self, named_atom atom) -> std::optional<int> {
-    auto& os = *self;
-    auto push_self = [&] {
-        lua_pushvalue(L, 1);
-        return 1;
+template <typename Reader>
+constexpr auto reader_methods() -> lua::method_table<Reader, named_atom> {
+    return {
+        {named_atom::readu8, read<uint8_t, Reader>},
+        {named_atom::readi8, read<int8_t, Reader>},
+        {named_atom::readu16, read<uint16_t, Reader>},
+        {named_atom::readi16, read<int16_t, Reader>},
+        {named_atom::readu32, read<uint32_t, Reader>},
+        {named_atom::readi32, read<int32_t, Reader>},
+        {named_atom::readf32, read<float, Reader>},
+        {named_atom::readf64, read<double, Reader>},
+        {named_atom::scan, [](lua_State* L, Reader& self) -> int {
+            // waiting on input should not hold up other threads of the state.
+            return get_runtime(L).tasks.await(L, [from = &stream(self)]() -> scheduler::continuation {
+                std::string str{};
+                *from >> str;
+                return [str = std::move(str)](lua_State* L) {return lua::push(L, str);};
+            });
+        }},
+        {named_atom::lines, [](lua_State* L, Reader& self) -> int {
+            lua::type<reader>::make(L, reader{stream(self)});
+            // keeps the stream that is read from alive.
+            lua_pushvalue(L, 1);
+            lua::push_cclosure(L, line_iterator_closure, "line_iterator", 2);
+            return 1;
+        }},
     };
-    using Named = named_atom;
-    switch (static_cast<Named>(atom)) {
-        case Named::writeu8:
-            write_number_raw<uint8_t>(self, L);
-            return push_self();
-        case Named::writei8:
-            write_number_raw<int8_t>(self, L);
-            return push_self();
-        case Named::writeu16:
-            write_number_raw<uint16_t>(self, L);
-            return push_self();
-        case Named::writei16:
-            write_number_raw<int16_t>(self, L);
-            return push_self();
-        case Named::writeu32:
-            write_number_raw<uint32_t>(self, L);
-            return push_self();
-        case Named::writei32:
-            write_number_raw<int32_t>(self, L);
-            return push_self();
-        case Named::writef32:
-            write_number_raw<float>(self, L);
-            return push_self();
-        case Named::writef64:
-            write_number_raw<double>(self, L);
-            return push_self();
-        case Named::write: {
+}
+template <typename Writer>
+constexpr auto writer_methods() -> lua::method_table<Writer, named_atom> {
+    return {
+        {named_atom::writeu8, write_number<uint8_t, Writer>},
+        {named_atom::writei8, write_number<int8_t, Writer>},
+        {named_atom::writeu16, write_number<uint16_t, Writer>},
+        {named_atom::writei16, write_number<int16_t, Writer>},
+        {named_atom::writeu32, write_number<uint32_t, Writer>},
+        {named_atom::writei32, write_number<int32_t, Writer>},
+        {named_atom::writef32, write_number<float, Writer>},
+        {named_atom::writef64, write_number<double, Writer>},
+        {named_atom::write, [](lua_State* L, Writer& self) -> int {
             if (lua_isbuffer(L, 2)) {
                 auto buf = lua::to_buffer(L, 2);
-                os.write(&buf.front(), buf.size());
-            } else if (lua_isstring(L, 2)) {
-                os << luaL_checkstring(L, 2);
-                return push_self();
+                stream(self).write(buf.data(), buf.size());
+            } else {
+                stream(self) << luaL_checkstring(L, 2);
             }
-            break;
-        }
-        case Named::flush:
-            os.flush();
-            return push_self();
-        case Named::eof:
-            return lua::push(L, self->eof());
-        case Named::good:
-            return lua::push(L, self->good());
-        case Named::bad:
-            return lua::push(L, self->bad());
-        case Named::fail:
-            return lua::push(L, self->fail());
-        case Named::clear:
-            self->clear();
-            return push_self();
-        case Named::seek:
-            self->seekp(luaL_checkinteger(L, 2), std::ios::beg);
-            return push_self();
-        case Named::tell:
-            return lua::push(L, static_cast<int>(self->tellp()));
-        default: return std::nullopt;
+            lua_pushvalue(L, 1);
+            return 1;
+        }},
+        {named_atom::flush, [](lua_State* L, Writer& self) -> int {
+            stream(self).flush();
+            lua_pushvalue(L, 1);
+            return 1;
+        }},
+        {named_atom::eof, [](lua_State* L, Writer& self) -> int {
+            return lua::push(L, stream(self).eof());
+        }},
+        {named_atom::good, [](lua_State* L, Writer& self) -> int {
+            return lua::push(L, stream(self).good());
+        }},
+        {named_atom::bad, [](lua_State* L, Writer& self) -> int {
+            return lua::push(L, stream(self).bad());
+        }},
+        {named_atom::fail, [](lua_State* L, Writer& self) -> int {
+            return lua::push(L, stream(self).fail());
+        }},
+        {named_atom::clear, [](lua_State* L, Writer& self) -> int {
+            stream(self).clear();
+            lua_pushvalue(L, 1);
+            return 1;
+        }},
+        {named_atom::seek, [](lua_State* L, Writer& self) -> int {
+            stream(self).seekp(luaL_checkinteger(L, 2), std::ios::beg);
+            lua_pushvalue(L, 1);
+            return 1;
+        }},
+        {named_atom::tell, [](lua_State* L, Writer& self) -> int {
+            return lua::push(L, static_cast<int>(stream(self).tellp()));
+        }},
+    };
+}
+// closes the file, optionally after calling the callback with it.
+template <typename File>
+static auto close(lua_State* L, File& self) -> int {
+    if (lua_isnoneornil(L, 2)) {
+        self.close();
+        return lua::none;
     }
-    return std::nullopt;
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 1);
+    auto return_values = *lua::pcall(L, 1).transform([&] {
+        return lua::push(L, true);
+    }).transform_error([&] (auto const& e) {
+        return lua::push_tuple(L, lua::nil, e);
+    });
+    self.close();
+    return return_values;
 }
+static constexpr auto writer_table = writer_methods<writer>();
+static constexpr auto filewriter_table = writer_methods<filewriter>().with({
+    {named_atom::close, close<filewriter>},
+});
+static constexpr auto reader_table = reader_methods<reader>();
+static constexpr auto filereader_table = reader_methods<filereader>().with({
+    {named_atom::close, close<filereader>},
+});
 TYPE_CONFIG (writer) {
     .type = "writer",
-    .namecall = [](lua_State* L) -> int {
-        auto& self = lua::type<writer>::to(L, 1);
-        auto const [atom, name] = lua::namecall_atom<named_atom>(L);
-        auto pushed = writer_namecall(L, self, atom);
-        if (not pushed) luaL_errorL(L, "invalid namecall '%s'.", name);
-        return *pushed;
-    },
+    .namecall = lua::namecall<writer, writer_table>,
     .call = [](lua_State* L) {
         auto& self = *lua::type<writer>::to(L, 1).get();
         self << lua::tostring_tuple(L, {.start_index = 2, .separator = ", "});
@@ -136,34 +155,11 @@ TYPE_CONFIG (writer) {
 TYPE_CONFIG (lib::io::filewriter) {
     .type = "filewriter",
     .on_setup = [](lua_State* L) {
-        lua::properties<lib::io::filewriter>::add("isopen", [](auto L, auto const& self) {
+        lua::properties<lib::io::filewriter>::add(L, "isopen", [](auto L, auto const& self) {
             return lua::push(L, self.is_open());
         });
     },
-    .namecall = [](lua_State* L) -> int {
-        auto& self = lua::type<filewriter>::to(L, 1);
-        auto const [atom, name] = lua::namecall_atom<named_atom>(L);
-        if (atom == named_atom::close) {
-            if (lua_isnoneornil(L, 2)) {
-                self.close();
-                return lua::none;
-            } else {
-                lua_pushvalue(L, 2);
-                lua_pushvalue(L, 1);
-                auto return_values = *lua::pcall(L, 1).transform([&] {
-                    return lua::push(L, true);
-                }).transform_error([&] (auto const& e) {
-                    return lua::push_tuple(L, lua::nil, e);
-                });
-                self.close();
-                return return_values;
-            }
-        }
-        auto ref = writer{self};
-        auto pushed = writer_namecall(L, ref, atom);
-        if (not pushed) luaL_errorL(L, "invalid namecall '%s'.", name);
-        return *pushed;
-    },
+    .namecall = lua::namecall<filewriter, filewriter_table>,
     .call = [](auto L) {
         auto& self = lua::type<lib::io::filewriter>::to(L, 1);
         self << lua::tostring_tuple(L, {.start_index = 2, .separator = ", "});
@@ -175,38 +171,9 @@ TYPE_CONFIG (lib::io::filewriter) {
 };
 TYPE_CONFIG (filereader) {
     .type = "filereader",
-    .namecall = [](lua_State* L) -> int {
-        auto& self = lua::type<filereader>::to(L, 1);
-        auto const [atom, name] = lua::namecall_atom<named_atom>(L);
-        if (atom == named_atom::close) {
-            if (lua_isnoneornil(L, 2)) {
-                self.close();
-                return lua::none;
-            } else {
-                lua_pushvalue(L, 2);
-                lua_pushvalue(L, 1);
-                auto return_values = *lua::pcall(L, 1).transform([&] {
-                    return lua::push(L, true);
-                }).transform_error([&] (auto const& e) {
-                    return lua::push_tuple(L, lua::nil, e);
-                });
-                self.close();
-                return return_values;
-            }
-        }
-        auto ref = reader{self};
-        auto pushed = reader_namecall(L, ref, atom);
-        if (not pushed) luaL_errorL(L, "invalid namecall '%s'.", name);
-        return *pushed;
-    }
+    .namecall = lua::namecall<filereader, filereader_table>,
 };
 TYPE_CONFIG (reader) {
     .type = "reader",
-    .namecall = [](lua_State* L) -> int {
-        auto& self = lua::type<reader>::to(L, 1);
-        auto const [atom, name] = lua::namecall_atom<named_atom>(L);
-        auto pushed = reader_namecall(L, self, atom);
-        if (not pushed) luaL_errorL(L, "invalid namecall '%s'.", name);
-        return *pushed;
-    },
+    .namecall = lua::namecall<reader, reader_table>,
 };
@@ -1,5 +1,6 @@
 #include "export.hpp"
 #include "lua/lua.hpp"
+#include "runtime.hpp"
 #include <cstdlib>
 #include <chrono>
 #include <thread>
@@ -12,12 +13,33 @@ static auto system(lua_State* L) -> int {
     return lua::push(L, exit_code);
 }
 static auto sleep(lua_State* L) -> int {
-    std::this_thread::sleep_for(sec_t{luaL_checknumber(L, 1)});
-    return lua::none;
+    return get_runtime(L).tasks.wait(L, luaL_checknumber(L, 1));
+}
+static auto memory(lua_State* L) -> int {
+    auto const& heap = get_runtime(L).heap;
+    lua_createtable(L, 0, 8);
+    lua::push(L, static_cast<double>(lua_totalbytes(L, -1)));
+    lua_setfield(L, -2, "total");
+    push_memory_categories(L);
+    lua_setfield(L, -2, "categories");
+    lua::push(L, static_cast<double>(heap.pooled_bytes));
+    lua_setfield(L, -2, "pooled");
+    lua::push(L, static_cast<double>(heap.large_bytes));
+    lua_setfield(L, -2, "large");
+    lua::push(L, static_cast<double>(heap.peak_bytes));
+    lua_setfield(L, -2, "peak");
+    lua::push(L, static_cast<double>(heap.allocations));
+    lua_setfield(L, -2, "allocations");
+    lua::push(L, static_cast<double>(heap.frees));
+    lua_setfield(L, -2, "frees");
+    lua::push(L, static_cast<double>(allocator::stats().reserved_bytes));
+    lua_setfield(L, -2, "reserved");
+    return 1;
 }
 void lib::proc::library(lua_State* L, int idx) {
     lua::set_functions(L, idx, std::to_array<luaL_Reg>({
         {"system", system},
         {"sleep", sleep},
+        {"memory", memory},
     }));
 }
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+struct lua_State;
+
+namespace lib::shm {
+// bounded ring of fixed size slots shared by the states of one process.
+// the header and the slots live in a single allocation. spsc rings expect
+// one pushing and one popping thread at a time, mpmc rings take any number
+// of both. push and pop move whole slots and never block.
+class ring {
+public:
+    enum class mode {
+        spsc,
+        mpmc,
+    };
+    // capacity is rounded up to a power of two.
+    static auto make(std::size_t capacity, std::size_t slot_size, mode kind) -> std::shared_ptr<ring>;
+    // number of slots moved, at most as many as the span holds.
+    auto push(std::span<const std::byte> data) -> std::size_t;
+    auto pop(std::span<std::byte> data) -> std::size_t;
+    // block until a slot can be pushed or popped, or the ring is closed.
+    void wait_writable() const;
+    void wait_readable() const;
+    using waiter = std::move_only_function<void()>;
+    // calls the waiter once when a slot can be pushed or popped or the ring
+    // is closed, right away when it already can. it runs on the thread that
+    // made room, so it should do no more than hand off to its own state.
+    void when_writable(waiter w);
+    void when_readable(waiter w);
+    // wakes up everyone waiting, queued slots can still be popped.
+    void close();
+    auto closed() const -> bool {return closed_.load(std::memory_order_acquire);}
+    auto capacity() const -> std::size_t {return mask_ + 1;}
+    auto slot_size() const -> std::size_t {return slot_size_;}
+    auto kind() const -> mode {return kind_;}
+    // slots queued right now, only a hint while others push or pop.
+    auto count() const -> std::size_t;
+    ~ring() = default;
+private:
+    ring(std::size_t capacity, std::size_t slot_size, mode kind);
+    auto slot(std::uint64_t pos) const -> std::byte*;
+    auto sequence(std::uint64_t pos) const -> std::atomic<std::uint64_t>&;
+    auto push_spsc(std::span<const std::byte> data) -> std::size_t;
+    auto pop_spsc(std::span<std::byte> data) -> std::size_t;
+    auto push_mpmc(std::span<const std::byte> data) -> std::size_t;
+    auto pop_mpmc(std::span<std::byte> data) -> std::size_t;
+    auto writable() const -> bool;
+    auto readable() const -> bool;
+    struct waiters {
+        // read without the lock by push and pop, which only lock when it is set.
+        std::atomic<std::size_t> count{};
+        std::vector<waiter> list;
+    };
+    void enqueue(waiters& to, bool (ring::*ready)() const, waiter w);
+    void wake(waiters& of);
+
+    // producers and consumers write to different cache lines.
+    alignas(64) std::atomic<std::uint64_t> tail_{};
+    alignas(64) std::atomic<std::uint64_t> head_{};
+    // bumped after every batch, waiters sleep on them with atomic::wait.
+    alignas(64) std::atomic<std::uint32_t> pushed_{};
+    std::atomic<std::uint32_t> popped_{};
+    std::atomic<bool> closed_{false};
+    std::mutex waiters_mutex_;
+    waiters writers_;
+    waiters readers_;
+    std::size_t mask_;
+    std::size_t slot_size_;
+    // mpmc slots are prefixed with their sequence number.
+    std::size_t stride_;
+    mode kind_;
+    std::byte* slots_;
+};
+using ring_handle = std::shared_ptr<ring>;
+void library(lua_State* L, int idx);
+}
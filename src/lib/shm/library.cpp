@@ -0,0 +1,25 @@
+#include "export.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+#include <string_view>
+using lib::shm::ring;
+
+// ring(capacity, slotsize = 1, mode = "mpmc")
+static auto new_ring(lua_State* L) -> int {
+    constexpr auto max_bytes = lua_Integer{1} << 30;
+    auto const capacity = luaL_checkinteger(L, 1);
+    auto const slot_size = luaL_optinteger(L, 2, 1);
+    std::string_view const kind = luaL_optstring(L, 3, "mpmc");
+    if (capacity < 1) luaL_argerrorL(L, 1, "capacity must be at least 1");
+    if (slot_size < 1) luaL_argerrorL(L, 2, "slot size must be at least 1");
+    if (capacity > max_bytes / slot_size) luaL_errorL(L, "ring would exceed 1 GiB");
+    if (kind != "spsc" and kind != "mpmc") luaL_argerrorL(L, 3, "expected 'spsc' or 'mpmc'");
+    lua::type<lib::shm::ring_handle>::make(L, ring::make(capacity, slot_size,
+        kind == "spsc" ? ring::mode::spsc : ring::mode::mpmc));
+    return 1;
+}
+void lib::shm::library(lua_State* L, int idx) {
+    lua::set_functions(L, idx, std::to_array<luaL_Reg>({
+        {"ring", new_ring},
+    }));
+}
@@ -0,0 +1,185 @@
+#include "export.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+using lib::shm::ring;
+
+constexpr auto ring_alignment = std::align_val_t{64};
+constexpr auto header_size = (sizeof(ring) + 63) / 64 * 64;
+using sequence_t = std::atomic<std::uint64_t>;
+
+ring::ring(std::size_t capacity, std::size_t slot_size, mode kind):
+    mask_(capacity - 1),
+    slot_size_(slot_size),
+    stride_(kind == mode::mpmc ? sizeof(sequence_t) + (slot_size + 7) / 8 * 8 : slot_size),
+    kind_(kind),
+    slots_(reinterpret_cast<std::byte*>(this) + header_size) {
+    if (kind == mode::mpmc) {
+        for (std::size_t i{}; i < capacity; ++i) std::construct_at(&sequence(i), i);
+    }
+}
+auto ring::make(std::size_t capacity, std::size_t slot_size, mode kind) -> std::shared_ptr<ring> {
+    capacity = std::bit_ceil(std::max<std::size_t>(capacity, 1));
+    auto const stride = kind == mode::mpmc ? sizeof(sequence_t) + (slot_size + 7) / 8 * 8 : slot_size;
+    auto memory = ::operator new(header_size + capacity * stride, ring_alignment);
+    auto self = new (memory) ring{capacity, slot_size, kind};
+    return {self, [](ring* self) {
+        self->~ring();
+        ::operator delete(self, ring_alignment);
+    }};
+}
+auto ring::slot(std::uint64_t pos) const -> std::byte* {
+    auto const cell = slots_ + (pos & mask_) * stride_;
+    return kind_ == mode::mpmc ? cell + sizeof(sequence_t) : cell;
+}
+auto ring::sequence(std::uint64_t pos) const -> sequence_t& {
+    return *std::launder(reinterpret_cast<sequence_t*>(slots_ + (pos & mask_) * stride_));
+}
+auto ring::push(std::span<const std::byte> data) -> std::size_t {
+    if (closed()) return 0;
+    auto const pushed = kind_ == mode::spsc ? push_spsc(data) : push_mpmc(data);
+    if (pushed > 0) {
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_all();
+        wake(readers_);
+    }
+    return pushed;
+}
+auto ring::pop(std::span<std::byte> data) -> std::size_t {
+    auto const popped = kind_ == mode::spsc ? pop_spsc(data) : pop_mpmc(data);
+    if (popped > 0) {
+        popped_.fetch_add(1, std::memory_order_release);
+        popped_.notify_all();
+        wake(writers_);
+    }
+    return popped;
+}
+// the batch is copied with at most two memcpys, one up to the end of the
+// slots and one from their start.
+auto ring::push_spsc(std::span<const std::byte> data) -> std::size_t {
+    auto const tail = tail_.load(std::memory_order_relaxed);
+    auto const head = head_.load(std::memory_order_acquire);
+    auto const count = std::min(data.size() / slot_size_, capacity() - (tail - head));
+    auto const first = std::min(count, capacity() - (tail & mask_));
+    std::memcpy(slot(tail), data.data(), first * slot_size_);
+    std::memcpy(slots_, data.data() + first * slot_size_, (count - first) * slot_size_);
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+}
+auto ring::pop_spsc(std::span<std::byte> data) -> std::size_t {
+    auto const head = head_.load(std::memory_order_relaxed);
+    auto const tail = tail_.load(std::memory_order_acquire);
+    auto const count = std::min(data.size() / slot_size_, static_cast<std::size_t>(tail - head));
+    auto const first = std::min(count, capacity() - (head & mask_));
+    std::memcpy(data.data(), slot(head), first * slot_size_);
+    std::memcpy(data.data() + first * slot_size_, slots_, (count - first) * slot_size_);
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+// bounded mpmc queue after Vyukov, a slot is free for position p when its
+// sequence equals p and filled when it equals p + 1.
+auto ring::push_mpmc(std::span<const std::byte> data) -> std::size_t {
+    auto const count = data.size() / slot_size_;
+    auto pushed = std::size_t{};
+    for (; pushed < count; ++pushed) {
+        auto pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            auto const seq = sequence(pos).load(std::memory_order_acquire);
+            auto const diff = static_cast<std::int64_t>(seq - pos);
+            if (diff == 0 and tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            if (diff < 0) return pushed;
+            if (diff > 0) pos = tail_.load(std::memory_order_relaxed);
+        }
+        std::memcpy(slot(pos), data.data() + pushed * slot_size_, slot_size_);
+        sequence(pos).store(pos + 1, std::memory_order_release);
+    }
+    return pushed;
+}
+auto ring::pop_mpmc(std::span<std::byte> data) -> std::size_t {
+    auto const count = data.size() / slot_size_;
+    auto popped = std::size_t{};
+    for (; popped < count; ++popped) {
+        auto pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            auto const seq = sequence(pos).load(std::memory_order_acquire);
+            auto const diff = static_cast<std::int64_t>(seq - (pos + 1));
+            if (diff == 0 and head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            if (diff < 0) return popped;
+            if (diff > 0) pos = head_.load(std::memory_order_relaxed);
+        }
+        std::memcpy(data.data() + popped * slot_size_, slot(pos), slot_size_);
+        sequence(pos).store(pos + mask_ + 1, std::memory_order_release);
+    }
+    return popped;
+}
+auto ring::writable() const -> bool {
+    auto const tail = tail_.load(std::memory_order_acquire);
+    if (kind_ == mode::spsc) return tail - head_.load(std::memory_order_acquire) < capacity();
+    return sequence(tail).load(std::memory_order_acquire) == tail;
+}
+auto ring::readable() const -> bool {
+    auto const head = head_.load(std::memory_order_acquire);
+    if (kind_ == mode::spsc) return tail_.load(std::memory_order_acquire) != head;
+    return sequence(head).load(std::memory_order_acquire) == head + 1;
+}
+void ring::wait_writable() const {
+    for (;;) {
+        auto const epoch = popped_.load(std::memory_order_acquire);
+        if (closed() or writable()) return;
+        popped_.wait(epoch, std::memory_order_acquire);
+    }
+}
+void ring::wait_readable() const {
+    for (;;) {
+        auto const epoch = pushed_.load(std::memory_order_acquire);
+        if (closed() or readable()) return;
+        pushed_.wait(epoch, std::memory_order_acquire);
+    }
+}
+// the fences pair up with the ones in wake, either the waiter sees the
+// room that was made or the one who made it sees the waiter.
+void ring::enqueue(waiters& to, bool (ring::*ready)() const, waiter w) {
+    {
+        auto lock = std::scoped_lock{waiters_mutex_};
+        to.count.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (not closed() and not (this->*ready)()) {
+            to.list.push_back(std::move(w));
+            return;
+        }
+        to.count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    w();
+}
+void ring::wake(waiters& of) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (of.count.load(std::memory_order_relaxed) == 0) return;
+    auto woken = std::vector<waiter>{};
+    {
+        auto lock = std::scoped_lock{waiters_mutex_};
+        woken.swap(of.list);
+        of.count.fetch_sub(woken.size(), std::memory_order_relaxed);
+    }
+    for (auto& w : woken) w();
+}
+void ring::when_writable(waiter w) {
+    enqueue(writers_, &ring::writable, std::move(w));
+}
+void ring::when_readable(waiter w) {
+    enqueue(readers_, &ring::readable, std::move(w));
+}
+void ring::close() {
+    closed_.store(true, std::memory_order_release);
+    pushed_.fetch_add(1, std::memory_order_release);
+    popped_.fetch_add(1, std::memory_order_release);
+    pushed_.notify_all();
+    popped_.notify_all();
+    wake(readers_);
+    wake(writers_);
+}
+auto ring::count() const -> std::size_t {
+    auto const tail = tail_.load(std::memory_order_acquire);
+    auto const head = head_.load(std::memory_order_acquire);
+    return tail > head ? std::min<std::size_t>(tail - head, capacity()) : 0;
+}
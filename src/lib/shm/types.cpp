@@ -0,0 +1,87 @@
+#include "export.hpp"
+#include "named_atom.hpp"
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+using lib::shm::ring;
+using lib::shm::ring_handle;
+using state = lua_State*;
+
+// the whole slots of the buffer at 2 from the byte offset at 3 on, at most
+// as many as the count at 4.
+static auto slots_of(state L, ring const& self) -> std::span<std::byte> {
+    auto size = size_t{};
+    auto const data = static_cast<std::byte*>(luaL_checkbuffer(L, 2, &size));
+    auto const offset = luaL_optinteger(L, 3, 0);
+    if (offset < 0 or static_cast<size_t>(offset) > size) luaL_argerrorL(L, 3, "offset out of range");
+    auto const available = (size - offset) / self.slot_size();
+    auto const count = luaL_optinteger(L, 4, static_cast<int>(available));
+    if (count < 0) luaL_argerrorL(L, 4, "count must not be negative");
+    auto const slots = std::min<size_t>(count, available);
+    return {data + offset, slots * self.slot_size()};
+}
+static auto push_count(state L, size_t count) -> int {
+    return lua::push(L, static_cast<double>(count));
+}
+// the wait variants park the calling thread until the ring has room, they
+// return 0 once it is closed or when another state was faster. the slots are
+// resolved before parking, the buffer stays pinned with the parked thread.
+// threads the scheduler does not own block instead.
+template <auto Move, auto Wait, auto When>
+static auto wait_and_move(state L, ring_handle& self) -> int {
+    auto const slots = slots_of(L, *self);
+    auto& tasks = get_runtime(L).tasks;
+    if (not tasks.owns(L)) {
+        ((*self).*Wait)();
+        return push_count(L, ((*self).*Move)(slots));
+    }
+    if (auto const moved = ((*self).*Move)(slots); moved > 0 or slots.empty() or self->closed()) {
+        return push_count(L, moved);
+    }
+    // the ring does not hold on to itself through its waiters, the handle on
+    // the stack of the parked thread keeps it alive.
+    auto const target = self.get();
+    return tasks.park(L, [target, slots](scheduler::waker wake) {
+        (target->*When)([target, slots, wake = std::move(wake)]() mutable {
+            wake([target, slots](state L) {return push_count(L, (target->*Move)(slots));});
+        });
+    });
+}
+static constexpr auto methods = lua::method_table<ring_handle, named_atom>{
+    {named_atom::push, [](state L, ring_handle& self) -> int {
+        return push_count(L, self->push(slots_of(L, *self)));
+    }},
+    {named_atom::pop, [](state L, ring_handle& self) -> int {
+        return push_count(L, self->pop(slots_of(L, *self)));
+    }},
+    {named_atom::waitpush, wait_and_move<&ring::push, &ring::wait_writable, &ring::when_writable>},
+    {named_atom::waitpop, wait_and_move<&ring::pop, &ring::wait_readable, &ring::when_readable>},
+    {named_atom::close, [](state L, ring_handle& self) -> int {
+        self->close();
+        return lua::none;
+    }},
+};
+TYPE_CONFIG (ring_handle) {
+    .type = "ring",
+    .on_setup = [](state L) {
+        using props = lua::properties<ring_handle>;
+        props::add(L, "capacity", [](state L, ring_handle const& self) {
+            return push_count(L, self->capacity());
+        });
+        props::add(L, "slotsize", [](state L, ring_handle const& self) {
+            return push_count(L, self->slot_size());
+        });
+        props::add(L, "count", [](state L, ring_handle const& self) {
+            return push_count(L, self->count());
+        });
+        props::add(L, "isclosed", [](state L, ring_handle const& self) {
+            return lua::push(L, self->closed());
+        });
+        props::add(L, "mode", [](state L, ring_handle const& self) {
+            return lua::push(L, self->kind() == ring::mode::spsc ? "spsc" : "mpmc");
+        });
+    },
+    .namecall = lua::namecall<ring_handle, methods>,
+    .index = lua::properties<ring_handle>::index,
+    .newindex = lua::properties<ring_handle>::newindex,
+};
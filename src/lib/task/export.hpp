@@ -0,0 +1,6 @@
+#pragma once
+struct lua_State;
+
+namespace lib::task {
+void library(lua_State* L, int idx);
+}
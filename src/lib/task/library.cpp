@@ -0,0 +1,57 @@
+#include "export.hpp"
+#include "lua/lua.hpp"
+#include "runtime.hpp"
+#include <array>
+
+// pushes the thread to schedule and moves the arguments following the
+// function or thread at idx onto it, returns the argument count.
+static auto prepare_thread(lua_State* L, int idx) -> int {
+    const int top = lua_gettop(L);
+    lua_State* thread{};
+    if (lua_isthread(L, idx)) {
+        thread = lua_tothread(L, idx);
+        lua_pushvalue(L, idx);
+    } else {
+        luaL_checktype(L, idx, LUA_TFUNCTION);
+        thread = lua_newthread(L);
+        lua_pushvalue(L, idx);
+        lua_xmove(L, thread, 1);
+    }
+    for (int i{idx + 1}; i <= top; ++i) {
+        lua_pushvalue(L, i);
+        lua_xmove(L, thread, 1);
+    }
+    return top - idx;
+}
+static auto spawn(lua_State* L) -> int {
+    auto const nargs = prepare_thread(L, 1);
+    get_runtime(L).tasks.spawn(L, -1, nargs);
+    return 1;
+}
+static auto defer(lua_State* L) -> int {
+    auto const nargs = prepare_thread(L, 1);
+    get_runtime(L).tasks.defer(L, -1, nargs);
+    return 1;
+}
+static auto delay(lua_State* L) -> int {
+    auto const seconds = luaL_checknumber(L, 1);
+    auto const nargs = prepare_thread(L, 2);
+    get_runtime(L).tasks.delay(L, -1, seconds, nargs);
+    return 1;
+}
+static auto wait(lua_State* L) -> int {
+    return get_runtime(L).tasks.wait(L, luaL_optnumber(L, 1, 0));
+}
+static auto cancel(lua_State* L) -> int {
+    luaL_checktype(L, 1, LUA_TTHREAD);
+    return lua::push(L, get_runtime(L).tasks.cancel(L, 1));
+}
+void lib::task::library(lua_State* L, int idx) {
+    lua::set_functions(L, idx, std::to_array<luaL_Reg>({
+        {"spawn", spawn},
+        {"defer", defer},
+        {"delay", delay},
+        {"wait", wait},
+        {"cancel", cancel},
+    }));
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <vector>
+#include <lib/shm/export.hpp>
+struct lua_State;
+
+namespace lib::thread {
+class channel;
+// values in a compact binary form, channels and rings travel beside the
+// bytes as shared handles.
+struct message {
+    std::string bytes;
+    std::vector<std::shared_ptr<channel>> channels;
+    std::vector<lib::shm::ring_handle> rings;
+};
+// bounded multi producer, multi consumer queue of messages. blocking calls
+// give up once the channel is closed or the stop token is triggered.
+class channel {
+public:
+    explicit channel(std::size_t capacity): capacity_(capacity) {}
+    auto send(message& m, std::stop_token stop = {}) -> bool;
+    auto receive(std::stop_token stop = {}) -> std::optional<message>;
+    auto try_send(message& m) -> bool;
+    auto try_receive() -> std::optional<message>;
+    // wakes up everyone waiting, queued messages can still be received.
+    void close();
+    auto closed() const -> bool;
+    auto capacity() const -> std::size_t {return capacity_;}
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable_any not_full_;
+    std::condition_variable_any not_empty_;
+    std::deque<message> queue_;
+    std::size_t capacity_;
+    bool closed_ = false;
+};
+// shared by the thread running a worker and the handles to it.
+struct worker_state {
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    std::string error;
+};
+using channel_handle = std::shared_ptr<channel>;
+using worker = std::shared_ptr<worker_state>;
+// stop token of the worker running on this native thread, one that never
+// triggers anywhere else.
+auto current_stop() -> std::stop_token;
+// serializes the values from first to last, fails on values that can not
+// leave their state such as functions.
+auto encode(lua_State* L, int first, int last) -> std::expected<message, std::string>;
+// pushes the values of the message, returns their count.
+auto decode(lua_State* L, message const& m) -> int;
+void library(lua_State* L, int idx);
+}
@@ -0,0 +1,77 @@
+// needs init_state and load_script of the root export.
+#include <export.hpp>
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+#include <algorithm>
+#include <thread>
+namespace fs = std::filesystem;
+using lib::thread::message;
+using lib::thread::worker;
+using lib::thread::channel_handle;
+
+static thread_local std::stop_token worker_stop{};
+auto lib::thread::current_stop() -> std::stop_token {
+    return worker_stop;
+}
+// runs the script in a state of its own with the decoded arguments, and
+// everything it scheduled after that. it prints to the streams of the
+// spawning state, which outlive it since the state joins its workers first.
+static void run_worker(std::stop_token stop, fs::path script, message args, worker self, state_config output) {
+    worker_stop = stop;
+    auto error = std::string{};
+    {
+        auto state = init_state(output);
+        auto L = state.get();
+        if (auto thread = load_script(L, script); not thread) {
+            error = thread.error();
+        } else {
+            auto const nargs = lib::thread::decode(*thread, args);
+            auto const status = lua_resume(*thread, L, nargs);
+            if (status != LUA_OK and status != LUA_YIELD) error = lua::tostring(*thread, -1);
+            else if (not get_runtime(L).tasks.run(L)) error = "a task of the worker failed";
+        }
+    }
+    {
+        auto lock = std::scoped_lock{self->mutex};
+        self->done = true;
+        self->error = std::move(error);
+    }
+    self->finished.notify_all();
+}
+// relative paths are resolved against the directory of the calling script.
+static auto resolve_script(lua_State* L, fs::path path) -> fs::path {
+    if (path.is_absolute()) return path;
+    auto ar = lua_Debug{};
+    if (lua_getinfo(L, 1, "s", &ar) and ar.source and *ar.source == '@') {
+        return fs::path{ar.source + 1}.parent_path() / path;
+    }
+    return fs::absolute(path);
+}
+static auto spawn(lua_State* L) -> int {
+    auto script = resolve_script(L, luaL_checkstring(L, 1));
+    auto args = lib::thread::encode(L, 2, lua_gettop(L));
+    if (not args) luaL_errorL(L, "%s", args.error().c_str());
+    auto self = std::make_shared<lib::thread::worker_state>();
+    auto& rt = get_runtime(L);
+    auto const output = state_config{.out = rt.out, .err = rt.err};
+    rt.workers.emplace_back(run_worker, std::move(script), std::move(*args), self, output);
+    lua::type<worker>::make(L, std::move(self));
+    return 1;
+}
+static auto channel(lua_State* L) -> int {
+    auto const capacity = luaL_optinteger(L, 1, 64);
+    if (capacity < 1) luaL_argerrorL(L, 1, "capacity must be at least 1");
+    lua::type<channel_handle>::make(L, std::make_shared<lib::thread::channel>(capacity));
+    return 1;
+}
+static auto cores(lua_State* L) -> int {
+    return lua::push(L, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+}
+void lib::thread::library(lua_State* L, int idx) {
+    lua::set_functions(L, idx, std::to_array<luaL_Reg>({
+        {"spawn", spawn},
+        {"channel", channel},
+        {"cores", cores},
+    }));
+}
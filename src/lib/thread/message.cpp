@@ -0,0 +1,216 @@
+#include "export.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <string_view>
+using lib::thread::message;
+using lib::thread::channel_handle;
+using lib::shm::ring_handle;
+
+// every value starts with its tag, tables end with tag::end after their
+// key value pairs. lengths and integers are varints.
+enum class tag : unsigned char {
+    nil,
+    false_,
+    true_,
+    integer,
+    number,
+    string,
+    buffer,
+    vector,
+    table,
+    end,
+    channel,
+    ring,
+};
+// past this depth the table is most likely cyclic.
+constexpr int max_depth = 128;
+
+namespace {
+struct encoder {
+    lua_State* L;
+    message out{};
+    std::string error{};
+
+    void put(tag t) {
+        out.bytes.push_back(static_cast<char>(t));
+    }
+    void put_varint(std::uint64_t v) {
+        for (; v >= 0x80; v >>= 7) out.bytes.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        out.bytes.push_back(static_cast<char>(v));
+    }
+    void put_bytes(const void* data, std::size_t size) {
+        out.bytes.append(static_cast<const char*>(data), size);
+    }
+    void put_number(double v) {
+        // integral numbers are the common case and mostly small.
+        if (v == std::trunc(v) and std::abs(v) < 0x1p53) {
+            auto const i = static_cast<std::int64_t>(v);
+            put(tag::integer);
+            put_varint((static_cast<std::uint64_t>(i) << 1) ^ static_cast<std::uint64_t>(i >> 63));
+            return;
+        }
+        put(tag::number);
+        put_bytes(&v, sizeof(v));
+    }
+    auto put_value(int idx, int depth) -> bool {
+        switch (lua_type(L, idx)) {
+            case LUA_TNIL: put(tag::nil); return true;
+            case LUA_TBOOLEAN: put(lua_toboolean(L, idx) ? tag::true_ : tag::false_); return true;
+            case LUA_TNUMBER: put_number(lua_tonumber(L, idx)); return true;
+            case LUA_TSTRING: {
+                auto size = size_t{};
+                auto const data = lua_tolstring(L, idx, &size);
+                put(tag::string);
+                put_varint(size);
+                put_bytes(data, size);
+                return true;
+            }
+            case LUA_TBUFFER: {
+                auto const data = lua::to_buffer(L, idx);
+                put(tag::buffer);
+                put_varint(data.size());
+                put_bytes(data.data(), data.size());
+                return true;
+            }
+            case LUA_TVECTOR: {
+                put(tag::vector);
+                put_bytes(lua_tovector(L, idx), sizeof(float) * LUA_VECTOR_SIZE);
+                return true;
+            }
+            case LUA_TTABLE: return put_table(idx, depth);
+            case LUA_TUSERDATA:
+                if (auto const ch = lua::type<channel_handle>::to_if(L, idx)) {
+                    put(tag::channel);
+                    put_varint(out.channels.size());
+                    out.channels.push_back(*ch);
+                    return true;
+                }
+                if (auto const r = lua::type<ring_handle>::to_if(L, idx)) {
+                    put(tag::ring);
+                    put_varint(out.rings.size());
+                    out.rings.push_back(*r);
+                    return true;
+                }
+                [[fallthrough]];
+            default:
+                error = std::format("can not send a value of type {}", luaL_typename(L, idx));
+                return false;
+        }
+    }
+    auto put_table(int idx, int depth) -> bool {
+        if (depth >= max_depth) {
+            error = "tables nested too deep to send, they may not be cyclic";
+            return false;
+        }
+        if (idx < 0) idx = lua_gettop(L) + idx + 1;
+        lua_checkstack(L, 3);
+        put(tag::table);
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+            if (not put_value(-2, depth + 1) or not put_value(-1, depth + 1)) {
+                lua_pop(L, 2);
+                return false;
+            }
+            lua_pop(L, 1);
+        }
+        put(tag::end);
+        return true;
+    }
+};
+struct decoder {
+    message const& in;
+    std::string_view bytes = in.bytes;
+
+    auto take(std::size_t size) -> std::string_view {
+        auto const taken = bytes.substr(0, size);
+        bytes.remove_prefix(taken.size());
+        return taken;
+    }
+    auto take_varint() -> std::uint64_t {
+        auto v = std::uint64_t{};
+        for (int shift{}; not bytes.empty(); shift += 7) {
+            auto const byte = static_cast<unsigned char>(bytes.front());
+            bytes.remove_prefix(1);
+            v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (not (byte & 0x80)) break;
+        }
+        return v;
+    }
+    auto take_tag() -> tag {
+        return static_cast<tag>(take(1).front());
+    }
+    // pushes the value the tag starts, tag::end pushes nothing.
+    auto push_value(lua_State* L, tag t) -> bool {
+        lua_checkstack(L, 3);
+        switch (t) {
+            case tag::nil: lua_pushnil(L); break;
+            case tag::false_: lua_pushboolean(L, false); break;
+            case tag::true_: lua_pushboolean(L, true); break;
+            case tag::integer: {
+                auto const v = take_varint();
+                lua_pushnumber(L, static_cast<double>(static_cast<std::int64_t>((v >> 1) ^ (0 - (v & 1)))));
+                break;
+            }
+            case tag::number: {
+                auto v = double{};
+                std::memcpy(&v, take(sizeof(v)).data(), sizeof(v));
+                lua_pushnumber(L, v);
+                break;
+            }
+            case tag::string: {
+                auto const data = take(take_varint());
+                lua_pushlstring(L, data.data(), data.size());
+                break;
+            }
+            case tag::buffer: {
+                auto const data = take(take_varint());
+                std::memcpy(lua_newbuffer(L, data.size()), data.data(), data.size());
+                break;
+            }
+            case tag::vector: {
+                auto v = std::array<float, 4>{};
+                std::memcpy(v.data(), take(sizeof(float) * LUA_VECTOR_SIZE).data(), sizeof(float) * LUA_VECTOR_SIZE);
+#if LUA_VECTOR_SIZE == 4
+                lua_pushvector(L, v[0], v[1], v[2], v[3]);
+#else
+                lua_pushvector(L, v[0], v[1], v[2]);
+#endif
+                break;
+            }
+            case tag::table: {
+                lua_newtable(L);
+                for (auto key = take_tag(); key != tag::end; key = take_tag()) {
+                    push_value(L, key);
+                    push_value(L, take_tag());
+                    lua_rawset(L, -3);
+                }
+                break;
+            }
+            case tag::channel:
+                lua::type<channel_handle>::make(L, in.channels[take_varint()]);
+                break;
+            case tag::ring:
+                lua::type<ring_handle>::make(L, in.rings[take_varint()]);
+                break;
+            case tag::end: return false;
+        }
+        return true;
+    }
+};
+}
+auto lib::thread::encode(lua_State* L, int first, int last) -> std::expected<message, std::string> {
+    auto e = encoder{.L = L};
+    for (int i{first}; i <= last; ++i) {
+        if (not e.put_value(i, 0)) return std::unexpected(std::move(e.error));
+    }
+    return std::move(e.out);
+}
+auto lib::thread::decode(lua_State* L, message const& m) -> int {
+    auto d = decoder{.in = m};
+    auto count = int{};
+    while (not d.bytes.empty()) count += d.push_value(L, d.take_tag());
+    return count;
+}
@@ -0,0 +1,131 @@
+#include "export.hpp"
+#include "named_atom.hpp"
+#include "lua/lua.hpp"
+#include "lua/typeutility.hpp"
+using lib::thread::channel;
+using lib::thread::channel_handle;
+using lib::thread::message;
+using lib::thread::worker;
+using state = lua_State*;
+
+auto channel::send(message& m, std::stop_token stop) -> bool {
+    auto lock = std::unique_lock{mutex_};
+    not_full_.wait(lock, stop, [this] {return closed_ or queue_.size() < capacity_;});
+    if (closed_ or stop.stop_requested()) return false;
+    queue_.push_back(std::move(m));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+auto channel::receive(std::stop_token stop) -> std::optional<message> {
+    auto lock = std::unique_lock{mutex_};
+    not_empty_.wait(lock, stop, [this] {return closed_ or not queue_.empty();});
+    if (queue_.empty()) return std::nullopt;
+    auto m = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return m;
+}
+auto channel::try_send(message& m) -> bool {
+    {
+        auto lock = std::scoped_lock{mutex_};
+        if (closed_ or queue_.size() >= capacity_) return false;
+        queue_.push_back(std::move(m));
+    }
+    not_empty_.notify_one();
+    return true;
+}
+auto channel::try_receive() -> std::optional<message> {
+    auto m = std::optional<message>{};
+    {
+        auto lock = std::scoped_lock{mutex_};
+        if (queue_.empty()) return std::nullopt;
+        m = std::move(queue_.front());
+        queue_.pop_front();
+    }
+    not_full_.notify_one();
+    return m;
+}
+void channel::close() {
+    {
+        auto lock = std::scoped_lock{mutex_};
+        closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+}
+auto channel::closed() const -> bool {
+    auto lock = std::scoped_lock{mutex_};
+    return closed_;
+}
+
+static auto encode_value(state L) -> message {
+    luaL_checkany(L, 2);
+    auto m = lib::thread::encode(L, 2, 2);
+    if (not m) luaL_errorL(L, "%s", m.error().c_str());
+    return std::move(*m);
+}
+// value and true, or nil and false when nothing was received.
+static auto push_received(state L, std::optional<message> const& m) -> int {
+    if (not m) return lua::push_tuple(L, lua::nil, false);
+    lib::thread::decode(L, *m);
+    return 1 + lua::push(L, true);
+}
+// blocking calls hold up the native thread, and with it every other thread
+// of the state. the try variants never block.
+static constexpr auto channel_methods = lua::method_table<channel_handle, named_atom>{
+    {named_atom::send, [](state L, channel_handle& self) -> int {
+        auto m = encode_value(L);
+        return lua::push(L, self->send(m, lib::thread::current_stop()));
+    }},
+    {named_atom::trysend, [](state L, channel_handle& self) -> int {
+        auto m = encode_value(L);
+        return lua::push(L, self->try_send(m));
+    }},
+    {named_atom::receive, [](state L, channel_handle& self) -> int {
+        return push_received(L, self->receive(lib::thread::current_stop()));
+    }},
+    {named_atom::tryreceive, [](state L, channel_handle& self) -> int {
+        return push_received(L, self->try_receive());
+    }},
+    {named_atom::close, [](state L, channel_handle& self) -> int {
+        self->close();
+        return lua::none;
+    }},
+};
+TYPE_CONFIG (channel_handle) {
+    .type = "channel",
+    .on_setup = [](state L) {
+        lua::properties<channel_handle>::add(L, "capacity", [](state L, channel_handle const& self) {
+            return lua::push(L, static_cast<double>(self->capacity()));
+        });
+        lua::properties<channel_handle>::add(L, "isclosed", [](state L, channel_handle const& self) {
+            return lua::push(L, self->closed());
+        });
+    },
+    .namecall = lua::namecall<channel_handle, channel_methods>,
+    .index = lua::properties<channel_handle>::index,
+    .newindex = lua::properties<channel_handle>::newindex,
+};
+static constexpr auto worker_methods = lua::method_table<worker, named_atom>{
+    // true once the worker finished, or nil and the error it failed with.
+    {named_atom::join, [](state L, worker& self) -> int {
+        auto lock = std::unique_lock{self->mutex};
+        self->finished.wait(lock, [&] {return self->done;});
+        if (not self->error.empty()) return lua::push_tuple(L, lua::nil, self->error);
+        return lua::push(L, true);
+    }},
+};
+TYPE_CONFIG (worker) {
+    .type = "worker",
+    .on_setup = [](state L) {
+        lua::properties<worker>::add(L, "running", [](state L, worker const& self) {
+            auto lock = std::scoped_lock{self->mutex};
+            return lua::push(L, not self->done);
+        });
+    },
+    .namecall = lua::namecall<worker, worker_methods>,
+    .index = lua::properties<worker>::index,
+    .newindex = lua::properties<worker>::newindex,
+};
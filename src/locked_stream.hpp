@@ -0,0 +1,40 @@
+#pragma once
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+
+// output stream of a state. workers spawned through wow.thread write to the
+// streams of the state that spawned them from their own native threads, so
+// every write is forwarded to the target right away under a lock.
+// errors are left on the target, a failed client or pipe does not silence
+// the state for good.
+class locked_stream : public std::ostream {
+public:
+    explicit locked_stream(std::ostream& target): std::ostream(&buffer_), buffer_(target) {}
+private:
+    class buffer : public std::streambuf {
+    public:
+        explicit buffer(std::ostream& target): target_(target) {}
+    protected:
+        auto overflow(int_type ch) -> int_type override {
+            if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+            auto lock = std::scoped_lock{mutex_};
+            target_.put(traits_type::to_char_type(ch));
+            return ch;
+        }
+        auto xsputn(const char* data, std::streamsize size) -> std::streamsize override {
+            auto lock = std::scoped_lock{mutex_};
+            target_.write(data, size);
+            return size;
+        }
+        auto sync() -> int override {
+            auto lock = std::scoped_lock{mutex_};
+            target_.flush();
+            return 0;
+        }
+    private:
+        std::ostream& target_;
+        std::mutex mutex_;
+    };
+    buffer buffer_;
+};
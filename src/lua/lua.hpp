@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <concepts>
 #include <utility>
 #include <string_view>
@@ -12,6 +13,7 @@
 #include <lualib.h>
 #include <luacode.h>
 #include <luacodegen.h>
+#include <Luau/CodeGen.h>
 #include <memory>
 
 namespace lua {
@@ -35,9 +37,56 @@ inline auto create(state L) -> bool {
     if (supported) luau_codegen_create(L);
     return supported;
 }
-inline auto compile(state L, int idx) {
-    luau_codegen_compile(L, idx);
-} 
+inline auto compile(state L, int idx, const char* const* userdata_types = nullptr) {
+    auto opts = Luau::CodeGen::CompilationOptions{};
+    opts.userdataTypes = userdata_types;
+    Luau::CodeGen::compile(L, idx, opts);
+}
+// resolves userdata type names recorded in bytecode type info to runtime tags.
+using userdata_remapper = Luau::CodeGen::UserdataRemapperCallback*;
+inline auto set_userdata_remapper(state L, userdata_remapper remapper, void* context = nullptr) {
+    if (luau_codegen_supported()) Luau::CodeGen::setUserdataRemapper(L, context, remapper);
+}
+}
+// optional instrumentation of C functions pushed through push_cfunction and
+// push_cclosure. the hook receives the debug name when a call enters and the
+// previously active name when it leaves, it returns the name it replaced.
+using binding_hook = const char*(*)(state L, const char* name);
+inline binding_hook on_binding = nullptr;
+namespace detail {
+struct binding_scope {
+    state L;
+    const char* previous;
+    binding_scope(state L, const char* name): L(L), previous(on_binding(L, name)) {}
+    ~binding_scope() {on_binding(L, previous);}
+};
+// the wrapped function and its name trail the upvalues of the original closure.
+template <int Upvalues>
+auto instrumented(state L) -> int {
+    auto const fn = reinterpret_cast<lua_CFunction>(lua_tolightuserdata(L, lua_upvalueindex(Upvalues + 1)));
+    auto const name = static_cast<const char*>(lua_tolightuserdata(L, lua_upvalueindex(Upvalues + 2)));
+    auto scope = binding_scope{L, name};
+    return fn(L);
+}
+}
+inline void push_cclosure(state L, lua_CFunction fn, const char* name, int upvalues = 0) {
+    constexpr auto max_instrumented_upvalues = 3;
+    if (not on_binding or upvalues > max_instrumented_upvalues) {
+        lua_pushcclosure(L, fn, name, upvalues);
+        return;
+    }
+    lua_pushlightuserdata(L, reinterpret_cast<void*>(fn));
+    lua_pushlightuserdata(L, const_cast<char*>(name));
+    constexpr auto wrappers = std::to_array<lua_CFunction>({
+        detail::instrumented<0>,
+        detail::instrumented<1>,
+        detail::instrumented<2>,
+        detail::instrumented<3>,
+    });
+    lua_pushcclosure(L, wrappers[upvalues], name, upvalues + 2);
+}
+inline void push_cfunction(state L, lua_CFunction fn, const char* name) {
+    push_cclosure(L, fn, name, 0);
 }
 struct state_options {
     bool codegen = true;
@@ -45,9 +94,12 @@ struct state_options {
     useratom useratom = nullptr;
     std::span<luaL_Reg> globals = {};
     bool sandbox = false;
+    // uses the system allocator when not set.
+    lua_Alloc allocator = nullptr;
+    void* allocator_data = nullptr;
 };
 inline auto new_state(state_options const& opt = {}) -> state_owner {
-    auto L = luaL_newstate();
+    auto L = opt.allocator ? lua_newstate(opt.allocator, opt.allocator_data) : luaL_newstate();
     if (opt.useratom) lua_callbacks(L)->useratom = opt.useratom;
     if (opt.codegen) codegen::create(L);
     if (opt.openlibs) luaL_openlibs(L);
@@ -55,7 +107,7 @@ inline auto new_state(state_options const& opt = {}) -> state_owner {
         lua_pushvalue(L, LUA_GLOBALSINDEX);
         for (auto const& [name, fn] : opt.globals) {
             if (not name or not fn) continue; 
-            lua_pushcfunction(L, fn, name);
+            push_cfunction(L, fn, name);
             lua_setfield(L, -2, name);
         }
         lua_pop(L, 1);
@@ -66,6 +118,7 @@ struct load_options {
     int env = 0;
     bool codegen = true;
     std::string chunkname = "anonymous";
+    const char* const* userdata_types = nullptr;
 };
 inline auto load(state L, std::span<char const> bytecode, load_options const& opts = {}) -> std::expected<void, std::string> {
     auto ok = LUA_OK == luau_load(L, opts.chunkname.c_str(), bytecode.data(), bytecode.size(), opts.env);
@@ -75,7 +128,7 @@ inline auto load(state L, std::span<char const> bytecode, load_options const& op
         return std::unexpected(errmsg);
     }
     if (opts.codegen) {
-        luau_codegen_compile(L, -1);
+        codegen::compile(L, -1, opts.userdata_types);
     }
     return {};
 }
@@ -229,7 +282,7 @@ inline void pop(state L, int amount = 1) {
 }
 inline void set_functions(lua_State* L, int idx, std::span<const luaL_Reg> fns) {
     for (auto const& entry : fns) {
-        lua_pushcfunction(L, entry.func, entry.name);
+        push_cfunction(L, entry.func, entry.name);
         lua_setfield(L, idx, entry.name);
     }
 }
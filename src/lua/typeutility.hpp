@@ -1,7 +1,13 @@
 #pragma once
 #include "lua.hpp"
+#include "comptime.hpp"
+#include <array>
+#include <atomic>
 #include <functional>
+#include <initializer_list>
 #include <optional>
+#include <mutex>
+#include <unordered_map>
 #define TYPE_CONFIG(T) template<> ::lua::type_config const ::lua::type<T>::config
 namespace lua::detail {
 inline int new_tag() {
@@ -15,6 +21,10 @@ constexpr void default_destructor(lua_State* L, void* userdata) {
 }
 
 namespace lua {
+// optional accounting of live userdata, receives 1 when a userdata of the
+// tag is made and -1 when it is destroyed.
+using userdata_hook = void(*)(lua_State* L, int tag, int delta);
+inline userdata_hook on_userdata = nullptr;
 struct type_config {
     std::string type = "unknown";
     std::function<void(lua_State*)> on_setup;
@@ -41,7 +51,7 @@ struct type {
             if (config.on_setup) config.on_setup(L);
             auto init_method = [&](auto name, auto fn) {
                 if (not fn) return;
-                lua_pushcfunction(L, fn, name);
+                lua::push_cfunction(L, fn, name);
                 lua_setfield(L, -2, name);
             };
             init_method("__index", config.index);
@@ -55,7 +65,10 @@ struct type {
             lua_setuserdatadtor(L, config.tag, [](lua_State* L, void* userdata) {
                 if (config.on_destroy) config.on_destroy(L, userdata);
                 detail::default_destructor<T>(L, userdata);
+                if (on_userdata) on_userdata(L, config.tag, -1);
             });
+            // shared by every script the state runs.
+            lua_setreadonly(L, -1, true);
         }
         lua_pop(L, 1);
         return init;
@@ -65,7 +78,14 @@ struct type {
     static auto make(lua_State* L, V&&...args) -> T& {
         auto p = static_cast<T*>(lua_newuserdatatagged(L, sizeof(T), config.tag));
         std::construct_at(p, std::forward<V>(args)...);
+        if (on_userdata) on_userdata(L, config.tag, 1);
         luaL_getmetatable(L, config.tname());
+        // metatables are set up on first use.
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            setup(L);
+            luaL_getmetatable(L, config.tname());
+        }
         lua_setmetatable(L, -2);
         return *p;
     }
@@ -97,40 +117,99 @@ struct type {
         return v ? *v : value;
     }
 };
+// per-type __namecall dispatch, indexed by the atom that useratom assigned
+// to the method name. declared as a constant next to the TYPE_CONFIG and
+// installed with .namecall = lua::namecall<T, table>.
+template <typename T>
+using method = int(*)(lua_State* L, T& self);
+template <typename T, comptime::SentinelEnum Atom>
+struct method_table {
+    std::array<method<T>, comptime::enum_size<Atom>()> methods{};
+    constexpr method_table(std::initializer_list<std::pair<Atom, method<T>>> entries) {
+        for (auto const& [atom, fn] : entries) methods[static_cast<std::size_t>(atom)] = fn;
+    }
+    // copy with additional or replaced entries.
+    constexpr auto with(std::initializer_list<std::pair<Atom, method<T>>> entries) const -> method_table {
+        auto copy = *this;
+        for (auto const& [atom, fn] : entries) copy.methods[static_cast<std::size_t>(atom)] = fn;
+        return copy;
+    }
+    constexpr auto find(int atom) const -> method<T> {
+        if (atom < 0 or atom >= static_cast<int>(methods.size())) return nullptr;
+        return methods[atom];
+    }
+};
+template <typename T, auto const& Table>
+auto namecall(lua_State* L) -> int {
+    auto atom = int{};
+    auto const name = lua_namecallatom(L, &atom);
+    if (auto const fn = Table.find(atom)) return fn(L, type<T>::to(L, 1));
+    luaL_errorL(L, "invalid namecall '%s'", name);
+}
+// __index and __newindex backed properties. names are resolved through the
+// string atom the useratom callback assigned, so a lookup is an array access.
 template <typename T>
 struct properties {
-    using getter = std::function<void(lua_State*, T&)>;
-    using setter = std::function<int(lua_State*, T const&)>;
+    using getter = int(*)(lua_State* L, T const& self);
+    using setter = void(*)(lua_State* L, T& self);
     struct property {
-        std::function<int(lua_State*, T const&)> get;
-        std::function<void(lua_State*, T&)> set;
+        // states may be set up concurrently from different threads.
+        std::atomic<getter> get{nullptr};
+        std::atomic<setter> set{nullptr};
     };
-    inline static std::unordered_map<std::string, property> map{};
-    static auto getter_for(std::string const& name) -> std::optional<setter> {
-        if (map.contains(name) and map[name].get) return map[name].get;
-        return std::nullopt;
+    static constexpr int max_atom = 256;
+    inline static std::array<property, max_atom> by_atom{};
+    // names without an atom, only looked at when the atom table misses.
+    inline static std::unordered_map<std::string, std::pair<getter, setter>> by_name{};
+    inline static std::mutex mutex{};
+
+    static void add(lua_State* L, const char* name, getter get = nullptr, setter set = nullptr) {
+        lua_pushstring(L, name);
+        auto atom = int{-1};
+        lua_tostringatom(L, -1, &atom);
+        lua_pop(L, 1);
+        if (atom >= 0 and atom < max_atom) {
+            by_atom[atom].get.store(get, std::memory_order_relaxed);
+            by_atom[atom].set.store(set, std::memory_order_relaxed);
+            return;
+        }
+        auto lock = std::scoped_lock{mutex};
+        by_name.insert({name, {get, set}});
     }
-    static auto setter_for(std::string const& name) -> std::optional<getter> {
-        if (map.contains(name) and map[name].set) return map[name].set;
-        return std::nullopt;
+    static auto getter_for(int atom, const char* name) -> getter {
+        if (atom >= 0 and atom < max_atom) return by_atom[atom].get.load(std::memory_order_relaxed);
+        auto lock = std::scoped_lock{mutex};
+        auto found = by_name.find(name);
+        return found != by_name.end() ? found->second.first : nullptr;
     }
-    static void add(std::string const& name, setter get = {}, getter set = {}) {
-        map.insert({name, property{.get = get, .set = set}});
+    static auto setter_for(int atom, const char* name) -> setter {
+        if (atom >= 0 and atom < max_atom) return by_atom[atom].set.load(std::memory_order_relaxed);
+        auto lock = std::scoped_lock{mutex};
+        auto found = by_name.find(name);
+        return found != by_name.end() ? found->second.second : nullptr;
     }
     static auto index(lua_State* L) -> int {
-        if (auto opt = getter_for(luaL_checkstring(L, 2))) {
+        auto atom = int{-1};
+        auto const name = lua_tostringatom(L, 2, &atom);
+        if (not name) luaL_typeerrorL(L, 2, "string");
+        if (auto const get = getter_for(atom, name)) {
             auto& self = type<T>::to(L, 1);
             lua_remove(L, 2);
-            return (*opt)(L, self);
-        } else luaL_errorL(L, "no getter set");
+            return get(L, self);
+        }
+        luaL_errorL(L, "no getter set for '%s'", name);
     }
     static auto newindex(lua_State* L) -> int {
-        if (auto opt = setter_for(luaL_checkstring(L, 2))) {
+        auto atom = int{-1};
+        auto const name = lua_tostringatom(L, 2, &atom);
+        if (not name) luaL_typeerrorL(L, 2, "string");
+        if (auto const set = setter_for(atom, name)) {
             auto& self = type<T>::to(L, 1);
             lua_remove(L, 2);
-            (*opt)(L, self);
+            set(L, self);
             return lua::none;
-        } else luaL_errorL(L, "no setter set");
+        }
+        luaL_errorL(L, "no setter set for '%s'", name);
     }
 };
 }
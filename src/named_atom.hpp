@@ -77,5 +77,44 @@ enum class named_atom {
     terminate,
     join,
     wait,
+    extension,
+    filename,
+    stem,
+    type,
+    canonical,
+    native,
+    body,
+    location,
+    version,
+    reason,
+    host,
+    isvalid,
+    port,
+    encodeurl,
+    keepalive,
+    connectiontimeout,
+    maxtimeout,
+    readtimeout,
+    writetimeout,
+    send,
+    trysend,
+    receive,
+    tryreceive,
+    capacity,
+    isclosed,
+    push,
+    pop,
+    waitpush,
+    waitpop,
+    slotsize,
+    count,
+    mode,
+    match,
+    expand,
+    readstring,
+    slice,
+    copy,
+    indexof,
+    advise,
     comptime_sentinel_keyword
 };
@@ -0,0 +1,195 @@
+#include "profiler.hpp"
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <print>
+#include <ranges>
+#include <thread>
+#include <vector>
+#include <lualib.h>
+namespace rgs = std::ranges;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+struct session {
+    std::mutex mutex;
+    std::vector<std::pair<lua_State*, profiler::samples*>> attached;
+    std::unordered_map<std::string, std::uint64_t> merged;
+    std::atomic<std::uint64_t> ticks{};
+    std::atomic<bool> running{false};
+    std::chrono::microseconds interval{};
+    std::jthread timer;
+};
+session current{};
+
+void merge(profiler::samples& s) {
+    for (auto const& [stack, count] : s.stacks) current.merged[stack] += count;
+    s.stacks.clear();
+}
+void format_frame(std::string& out, lua_Debug const& ar) {
+    auto const name = ar.name ? ar.name : "anonymous";
+    out.clear();
+    if (ar.what and *ar.what == 'C') {
+        out.append(name);
+    } else {
+        std::format_to(std::back_inserter(out), "{}:{}:{}", ar.short_src, name, ar.linedefined);
+    }
+}
+void trigger(lua_State* L, int gc) {
+    // gc steps report through the interrupt as well.
+    if (gc >= 0) {
+        if (auto const base = get_runtime(L).base_interrupt) base(L, gc);
+        return;
+    }
+    lua_callbacks(L)->interrupt = get_runtime(L).base_interrupt;
+    auto const s = get_runtime(L).profiling;
+    if (not s) return;
+    auto const now = current.ticks.load(std::memory_order_relaxed);
+    auto const elapsed = now - s->seen_ticks;
+    if (elapsed == 0) return;
+    s->seen_ticks = now;
+    auto const in_binding = std::min(s->binding_ticks.exchange(0, std::memory_order_relaxed), elapsed);
+
+    thread_local auto frames = std::vector<std::string>{};
+    auto depth = size_t{};
+    auto ar = lua_Debug{};
+    for (int level{}; lua_getinfo(L, level, "sn", &ar); ++level) {
+        if (depth == frames.size()) frames.emplace_back();
+        format_frame(frames[depth++], ar);
+    }
+    auto& stack = s->scratch;
+    stack.clear();
+    for (auto i = depth; i-- > 0;) {
+        if (not stack.empty()) stack.push_back(';');
+        stack.append(frames[i]);
+    }
+    if (elapsed > in_binding) s->stacks[stack] += elapsed - in_binding;
+    if (in_binding == 0) return;
+    // the binding already returned, charge it as a leaf of the calling frame.
+    if (auto const binding = s->sampled_binding.load(std::memory_order_relaxed)) {
+        if (not stack.empty()) stack.push_back(';');
+        stack.append(binding);
+    }
+    s->stacks[stack] += in_binding;
+}
+auto binding_hook(lua_State* L, const char* name) -> const char* {
+    auto const s = get_runtime(L).profiling;
+    if (not s) return nullptr;
+    return s->binding.exchange(name, std::memory_order_relaxed);
+}
+void timer_loop(std::stop_token stop, std::chrono::microseconds interval) {
+    auto next = clock_type::now();
+    while (not stop.stop_requested()) {
+        next += interval;
+        std::this_thread::sleep_until(next);
+        current.ticks.fetch_add(1, std::memory_order_relaxed);
+        auto lock = std::scoped_lock{current.mutex};
+        for (auto const& [L, s] : current.attached) {
+            if (auto const binding = s->binding.load(std::memory_order_relaxed)) {
+                s->sampled_binding.store(binding, std::memory_order_relaxed);
+                s->binding_ticks.fetch_add(1, std::memory_order_relaxed);
+            }
+            // same approach as the Luau CLI profiler: the callback is raised
+            // from this thread and cleared again by the VM thread.
+            lua_callbacks(L)->interrupt = trigger;
+        }
+    }
+}
+void write_summary(std::ostream& out) {
+    struct counts {
+        std::uint64_t self{};
+        std::uint64_t total{};
+    };
+    auto functions = std::unordered_map<std::string_view, counts>{};
+    auto total = std::uint64_t{};
+    for (auto const& [stack, count] : current.merged) {
+        total += count;
+        auto seen = std::vector<std::string_view>{};
+        for (auto frame : std::views::split(std::string_view{stack}, ';')) {
+            auto const name = std::string_view{frame.begin(), frame.end()};
+            // recursion should count once towards the inclusive total.
+            if (rgs::find(seen, name) == seen.end()) {
+                functions[name].total += count;
+                seen.push_back(name);
+            }
+        }
+        if (not seen.empty()) {
+            // npos wraps around to the start of a single frame stack.
+            functions[std::string_view{stack}.substr(stack.rfind(';') + 1)].self += count;
+        }
+    }
+    auto rows = std::vector<std::pair<std::string_view, counts>>{functions.begin(), functions.end()};
+    rgs::sort(rows, [](auto const& a, auto const& b) {return a.second.self > b.second.self;});
+    auto const ms_per_tick = std::chrono::duration<double, std::milli>{current.interval}.count();
+    auto const percent = [&](std::uint64_t v) {return total ? 100.0 * v / total : 0.0;};
+    std::println(out, "profile: {} samples, {:.1f} ms", total, total * ms_per_tick);
+    std::println(out, "{:>10} {:>7} {:>10} {:>7}  {}", "self ms", "self%", "total ms", "total%", "function");
+    constexpr auto max_rows = size_t{25};
+    for (auto const& [name, c] : rows | std::views::take(max_rows)) {
+        std::println(out, "{:>10.1f} {:>6.1f}% {:>10.1f} {:>6.1f}%  {}",
+            c.self * ms_per_tick, percent(c.self),
+            c.total * ms_per_tick, percent(c.total),
+            name
+        );
+    }
+}
+}
+
+void profiler::start(std::chrono::microseconds interval) {
+    if (current.running.exchange(true)) return;
+    current.interval = interval;
+    lua::on_binding = binding_hook;
+    current.timer = std::jthread{timer_loop, interval};
+}
+auto profiler::active() -> bool {
+    return current.running.load();
+}
+void profiler::attach(lua_State* L) {
+    if (not active()) return;
+    auto s = new samples{};
+    s->seen_ticks = current.ticks.load();
+    get_runtime(L).profiling = s;
+    auto lock = std::scoped_lock{current.mutex};
+    current.attached.emplace_back(L, s);
+}
+void profiler::idle_begin(lua_State* L) {
+    if (auto const s = get_runtime(L).profiling) s->idle_since = current.ticks.load(std::memory_order_relaxed);
+}
+void profiler::idle_end(lua_State* L) {
+    auto const s = get_runtime(L).profiling;
+    if (not s) return;
+    auto const idle = current.ticks.load(std::memory_order_relaxed) - s->idle_since;
+    if (idle == 0) return;
+    s->stacks["[idle]"] += idle;
+    s->seen_ticks += idle;
+}
+void profiler::detach(lua_State* L) {
+    auto& rt = get_runtime(L);
+    if (not rt.profiling) return;
+    {
+        auto lock = std::scoped_lock{current.mutex};
+        std::erase_if(current.attached, [L](auto const& e) {return e.first == L;});
+        merge(*rt.profiling);
+    }
+    lua_callbacks(L)->interrupt = rt.base_interrupt;
+    delete std::exchange(rt.profiling, nullptr);
+}
+void profiler::stop(std::filesystem::path const& folded, std::ostream& summary) {
+    if (not current.running.exchange(false)) return;
+    current.timer = {};
+    lua::on_binding = nullptr;
+    auto lock = std::scoped_lock{current.mutex};
+    for (auto const& [L, s] : current.attached) merge(*s);
+    auto sorted = std::map<std::string_view, std::uint64_t>{current.merged.begin(), current.merged.end()};
+    if (auto file = std::ofstream{folded}) {
+        for (auto const& [stack, count] : sorted) std::println(file, "{} {}", stack, count);
+    } else {
+        std::println(summary, "failed to write profile '{}'", folded.string());
+    }
+    write_summary(summary);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+struct lua_State;
+
+// sampling profiler driven by the VM interrupt. a timer thread counts ticks
+// and raises the interrupt of every attached state, the state then charges
+// the elapsed ticks to its current call stack at the next safepoint.
+// C bindings are attributed through the lua::on_binding hook.
+namespace profiler {
+struct samples {
+    // set by the binding hook while a C binding runs.
+    std::atomic<const char*> binding{nullptr};
+    // last binding the timer caught running, and how many ticks it caught it for.
+    std::atomic<const char*> sampled_binding{nullptr};
+    std::atomic<std::uint64_t> binding_ticks{};
+    std::uint64_t seen_ticks{};
+    // tick the scheduler went idle at.
+    std::uint64_t idle_since{};
+    std::unordered_map<std::string, std::uint64_t> stacks;
+    std::string scratch;
+};
+void start(std::chrono::microseconds interval);
+auto active() -> bool;
+void attach(lua_State* L);
+// called by the scheduler around the waits of an idle state. the ticks in
+// between are charged to an [idle] frame rather than to the stack that
+// happens to reach the next safepoint.
+void idle_begin(lua_State* L);
+void idle_end(lua_State* L);
+// merges the samples of the state, must be called before it is closed.
+void detach(lua_State* L);
+// stops sampling, writes folded stacks to the file and a summary table to the stream.
+void stop(std::filesystem::path const& folded, std::ostream& summary);
+}
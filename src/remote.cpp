@@ -0,0 +1,361 @@
+#include "remote.hpp"
+#include "export.hpp"
+#include <print>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <csignal>
+#include <format>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+namespace fs = std::filesystem;
+using namespace std::string_view_literals;
+
+#ifdef _WIN32
+auto remote::default_socket() -> fs::path {
+    return {};
+}
+auto remote::serve(fs::path const&, unsigned) -> bool {
+    std::println(stderr, "wow serve requires unix domain sockets");
+    return false;
+}
+auto remote::run(fs::path const&, fs::path const&, std::span<std::string_view const>) -> std::optional<int> {
+    return std::nullopt;
+}
+#else
+// every message is [type: u8][size: u32 little endian][payload].
+enum class frame : char {
+    // working directory of the client, the absolute script path and the
+    // arguments, separated by '\0'.
+    request = 'R',
+    out = 'O',
+    err = 'E',
+    // single byte exit code, last frame of a request.
+    exit = 'X',
+};
+// requests are a path and a few arguments, output is sent in small chunks.
+constexpr std::uint32_t max_frame_size = 16 * 1024 * 1024;
+static auto write_all(int fd, const char* data, size_t size) -> bool {
+    while (size > 0) {
+        auto const n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+static auto read_all(int fd, char* data, size_t size) -> bool {
+    while (size > 0) {
+        auto const n = ::recv(fd, data, size, 0);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+static auto send_frame(int fd, frame type, std::string_view payload) -> bool {
+    auto const size = static_cast<std::uint32_t>(payload.size());
+    auto const header = std::array<char, 5>{
+        static_cast<char>(type),
+        static_cast<char>(size & 0xff),
+        static_cast<char>(size >> 8 & 0xff),
+        static_cast<char>(size >> 16 & 0xff),
+        static_cast<char>(size >> 24 & 0xff),
+    };
+    return write_all(fd, header.data(), header.size()) and write_all(fd, payload.data(), payload.size());
+}
+static auto read_frame(int fd) -> std::optional<std::pair<frame, std::string>> {
+    auto header = std::array<unsigned char, 5>{};
+    if (not read_all(fd, reinterpret_cast<char*>(header.data()), header.size())) return std::nullopt;
+    auto const size = std::uint32_t{header[1]} | std::uint32_t{header[2]} << 8
+        | std::uint32_t{header[3]} << 16 | std::uint32_t{header[4]} << 24;
+    if (size > max_frame_size) return std::nullopt;
+    auto payload = std::string(size, '\0');
+    if (not read_all(fd, payload.data(), size)) return std::nullopt;
+    return std::pair{static_cast<frame>(header[0]), std::move(payload)};
+}
+// streams what a script prints back to the client as frames of one type.
+class frame_buffer : public std::streambuf {
+public:
+    explicit frame_buffer(frame type): type_(type) {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+    void attach(int fd) {
+        fd_ = fd;
+    }
+protected:
+    auto overflow(int_type ch) -> int_type override {
+        if (sync() != 0) return traits_type::eof();
+        if (not traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+    auto sync() -> int override {
+        auto const pending = std::string_view{pbase(), pptr()};
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        if (pending.empty() or fd_ < 0) return 0;
+        return send_frame(fd_, type_, pending) ? 0 : -1;
+    }
+private:
+    frame type_;
+    int fd_ = -1;
+    std::array<char, 4096> buffer_{};
+};
+class connection_queue {
+public:
+    void push(int fd) {
+        {
+            auto lock = std::scoped_lock{mutex_};
+            pending_.push_back(fd);
+        }
+        ready_.notify_one();
+    }
+    auto pop() -> std::optional<int> {
+        auto lock = std::unique_lock{mutex_};
+        ready_.wait(lock, [this] {return closed_ or not pending_.empty();});
+        if (pending_.empty()) return std::nullopt;
+        auto const fd = pending_.front();
+        pending_.pop_front();
+        return fd;
+    }
+    void close() {
+        {
+            auto lock = std::scoped_lock{mutex_};
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<int> pending_;
+    bool closed_ = false;
+};
+// the working directory is process wide and shared with the worker pool,
+// so requests only run together when they share it. a request from
+// another directory waits until the running ones are done.
+class directory_gate {
+public:
+    auto enter(fs::path const& directory) -> bool {
+        auto lock = std::unique_lock{mutex_};
+        left_.wait(lock, [&] {return active_ == 0 or current_ == directory;});
+        if (current_ != directory) {
+            auto ec = std::error_code{};
+            fs::current_path(directory, ec);
+            if (ec) return false;
+            current_ = directory;
+        }
+        ++active_;
+        return true;
+    }
+    void leave() {
+        {
+            auto lock = std::scoped_lock{mutex_};
+            --active_;
+        }
+        left_.notify_all();
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable left_;
+    fs::path current_ = fs::current_path();
+    int active_ = 0;
+};
+static auto split_request(std::string_view payload) -> std::vector<std::string_view> {
+    auto parts = std::vector<std::string_view>{};
+    for (auto end = payload.find('\0'); end != std::string_view::npos; end = payload.find('\0')) {
+        parts.push_back(payload.substr(0, end));
+        payload.remove_prefix(end + 1);
+    }
+    parts.push_back(payload);
+    return parts;
+}
+// one warm state per worker, every request runs in a fresh sandboxed thread of it.
+static void serve_connections(connection_queue& queue, directory_gate& directory) {
+    auto out = frame_buffer{frame::out};
+    auto err = frame_buffer{frame::err};
+    auto out_stream = std::ostream{&out};
+    auto err_stream = std::ostream{&err};
+    auto state = init_state({.out = &out_stream, .err = &err_stream});
+    auto L = state.get();
+    while (auto const fd = queue.pop()) {
+        if (auto request = read_frame(*fd); request and request->first == frame::request) {
+            auto const parts = split_request(request->second);
+            if (parts.size() < 2) {
+                ::close(*fd);
+                continue;
+            }
+            out.attach(*fd);
+            err.attach(*fd);
+            out_stream.clear();
+            err_stream.clear();
+            auto ok = false;
+            if (directory.enter(fs::path{parts[0]})) {
+                invalidate_stale_modules(L);
+                ok = run_script(L, parts[1], std::span{parts}.subspan(2));
+                // workers print to this client and run in its directory, they
+                // are joined before the frame buffers are detached.
+                get_runtime(L).workers.clear();
+                directory.leave();
+            } else {
+                std::println(err_stream, "\033[35mError: no such working directory '{}'\033[0m", parts[0]);
+            }
+            out_stream.flush();
+            err_stream.flush();
+            out.attach(-1);
+            err.attach(-1);
+            send_frame(*fd, frame::exit, ok ? "\0"sv : "\1"sv);
+        }
+        ::close(*fd);
+    }
+}
+static auto make_address(fs::path const& socket) -> std::optional<sockaddr_un> {
+    auto address = sockaddr_un{.sun_family = AF_UNIX};
+    auto const path = socket.string();
+    if (path.size() >= sizeof(address.sun_path)) return std::nullopt;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+// the socket path may have been taken by someone else first, neither side
+// talks to a process of another user.
+static auto peer_is_user(int fd) -> bool {
+#ifdef __linux__
+    auto credentials = ucred{};
+    auto size = socklen_t{sizeof(credentials)};
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) return false;
+    return credentials.uid == ::getuid();
+#else
+    auto uid = uid_t{};
+    auto gid = gid_t{};
+    if (::getpeereid(fd, &uid, &gid) != 0) return false;
+    return uid == ::getuid();
+#endif
+}
+static auto connect_to(fs::path const& socket) -> int {
+    auto const address = make_address(socket);
+    if (not address) return -1;
+    auto const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr const*>(&*address), sizeof(*address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+static volatile std::sig_atomic_t stopping = 0;
+static volatile std::sig_atomic_t listening = -1;
+
+auto remote::default_socket() -> fs::path {
+    if (auto const dir = std::getenv("XDG_RUNTIME_DIR"); dir and *dir) return fs::path{dir} / "wow.sock";
+    return std::format("/tmp/wow-{}/wow.sock", ::getuid());
+}
+auto remote::serve(fs::path const& socket, unsigned states) -> bool {
+    auto const address = make_address(socket);
+    if (not address) {
+        std::println(stderr, "socket path '{}' is too long", socket.string());
+        return false;
+    }
+    if (auto const running = connect_to(socket); running >= 0) {
+        ::close(running);
+        std::println(stderr, "already serving on '{}'", socket.string());
+        return false;
+    }
+    // private to the user when it does not exist yet, like the default one in /tmp.
+    if (auto const parent = socket.parent_path(); not parent.empty() and not fs::exists(parent)) {
+        if (::mkdir(parent.c_str(), S_IRWXU) != 0) {
+            std::println(stderr, "failed to create '{}': {}", parent.string(), std::strerror(errno));
+            return false;
+        }
+    }
+    // left behind by a daemon that did not shut down cleanly.
+    ::unlink(socket.c_str());
+    auto const listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0
+        or ::bind(listener, reinterpret_cast<sockaddr const*>(&*address), sizeof(*address)) != 0
+        or ::chmod(socket.c_str(), S_IRUSR | S_IWUSR) != 0
+        or ::listen(listener, SOMAXCONN) != 0) {
+        std::println(stderr, "failed to listen on '{}': {}", socket.string(), std::strerror(errno));
+        if (listener >= 0) ::close(listener);
+        return false;
+    }
+    // the signal may land on any thread, shutting the listener down wakes
+    // up accept wherever it went.
+    listening = listener;
+    struct sigaction action{};
+    action.sa_handler = [](int) {
+        stopping = 1;
+        ::shutdown(listening, SHUT_RDWR);
+    };
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+    auto queue = connection_queue{};
+    auto directory = directory_gate{};
+    {
+        auto workers = std::vector<std::jthread>{};
+        for (unsigned i{}; i < states; ++i) workers.emplace_back(serve_connections, std::ref(queue), std::ref(directory));
+        std::println(stderr, "serving on '{}' with {} states", socket.string(), states);
+        while (not stopping) {
+            auto const fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0 and not peer_is_user(fd)) ::close(fd);
+            else if (fd >= 0) queue.push(fd);
+            else if (stopping or (errno != EINTR and errno != ECONNABORTED)) break;
+        }
+        queue.close();
+    }
+    ::close(listener);
+    ::unlink(socket.c_str());
+    return true;
+}
+auto remote::run(fs::path const& socket, fs::path const& script, std::span<std::string_view const> args) -> std::optional<int> {
+    auto const fd = connect_to(socket);
+    if (fd < 0) return std::nullopt;
+    if (not peer_is_user(fd)) {
+        ::close(fd);
+        std::println(stderr, "'{}' is served by another user, not sending the script", socket.string());
+        return 1;
+    }
+    // the script runs in the working directory of the client, the
+    // environment stays the one of the daemon.
+    auto request = fs::current_path().string();
+    request.push_back('\0');
+    request.append(fs::absolute(script).string());
+    for (auto arg : args) {
+        request.push_back('\0');
+        request.append(arg);
+    }
+    auto code = 1;
+    if (send_frame(fd, frame::request, request)) {
+        while (auto const received = read_frame(fd)) {
+            auto const& [type, payload] = *received;
+            if (type == frame::out) std::cout.write(payload.data(), payload.size()).flush();
+            else if (type == frame::err) std::cerr.write(payload.data(), payload.size()).flush();
+            else if (type == frame::exit) {
+                code = payload.empty() ? 1 : payload.front();
+                break;
+            }
+        }
+    }
+    ::close(fd);
+    return code;
+}
+#endif
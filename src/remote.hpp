@@ -0,0 +1,19 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// warm runtime daemon. `wow serve` keeps a pool of initialized states behind
+// a unix socket, `wow run --remote` sends it a script with its arguments and
+// receives the output of the script while it runs. scripts run in the
+// working directory of the client but see the environment of the daemon,
+// getenv inside of them reads the variables `wow serve` was started with.
+namespace remote {
+// $XDG_RUNTIME_DIR/wow.sock, or a socket in a private per user directory in /tmp.
+auto default_socket() -> std::filesystem::path;
+// accepts requests until interrupted, every state of the pool runs one at a time.
+auto serve(std::filesystem::path const& socket, unsigned states) -> bool;
+// exit code of the script, nullopt when no daemon listens on the socket.
+auto run(std::filesystem::path const& socket, std::filesystem::path const& script, std::span<std::string_view const> args) -> std::optional<int>;
+}
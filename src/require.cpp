@@ -1,7 +1,84 @@
 #include "export.hpp"
+#include "bytecode_cache.hpp"
+#include "resolve.hpp"
+#include "worker_pool.hpp"
 #include "Luau/ReplRequirer.h"
 #include "Luau/Coverage.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <unordered_set>
 constexpr auto context_key = "__REQUIRE_CONTEXT";
+// registry table Luau.Require caches the results of modules in.
+constexpr auto module_cache_key = "_MODULES";
+
+// the source file a module is loaded from.
+static auto module_file(const char* path, const char* chunkname) -> std::filesystem::path {
+    auto ec = std::error_code{};
+    auto file = std::filesystem::path{path};
+    if (not std::filesystem::is_regular_file(file, ec) and *chunkname == '@') file = chunkname + 1;
+    return file;
+}
+// remembers the mtime of the source file the module was loaded from.
+static void track_module(lua_State* L, std::filesystem::path const& file) {
+    namespace fs = std::filesystem;
+    auto ec = std::error_code{};
+    auto const mtime = fs::last_write_time(file, ec);
+    if (not ec) get_runtime(L).modules.insert_or_assign(file.string(), mtime);
+}
+
+// mirrors the ReplRequirer loader, but compiles through the bytecode cache.
+static auto load(lua_State* L, void* ctx, const char* path, const char* chunkname, const char* contents) -> int {
+    auto req = static_cast<ReplRequirer*>(ctx);
+    // module needs to run in a new thread, isolated from the rest
+    auto GL = lua_mainthread(L);
+    auto ML = lua_newthread(GL);
+    lua_xmove(GL, L, 1);
+    luaL_sandboxthread(ML);
+    set_memory_category(ML, memory_category::modules);
+
+    auto const file = module_file(path, chunkname);
+    auto const bytecode = bytecode_cache::compile_shared(file, {contents, std::strlen(contents)}, compile_options());
+    auto loaded = lua::load(ML, *bytecode, {
+        .codegen = req->codegenEnabled(),
+        .chunkname = chunkname,
+        .userdata_types = userdata_types::names(),
+    });
+    if (not loaded) {
+        lua::push(ML, loaded.error());
+    } else {
+        track_module(L, file);
+        if (req->coverageActive()) req->coverageTrack(ML, -1);
+        // the loader expects the module to finish without yielding.
+        auto& tasks = get_runtime(L).tasks;
+        tasks.set_blocking(ML, true);
+        auto status = lua_resume(ML, L, 0);
+        tasks.set_blocking(ML, false);
+        if (status == LUA_OK) {
+            if (lua_gettop(ML) == 0) {
+                lua_pushstring(ML, "module must return a value");
+            } else if (not lua_istable(ML, -1) and not lua_isfunction(ML, -1)) {
+                lua_pushstring(ML, "module must return a table or function");
+            }
+        } else if (status == LUA_YIELD) {
+            lua_pushstring(ML, "module can not yield");
+        } else if (not lua_isstring(ML, -1)) {
+            lua_pushstring(ML, "unknown error while running module");
+        }
+    }
+    // add ML result to L stack
+    lua_xmove(ML, L, 1);
+    if (lua_isstring(L, -1)) lua_error(L);
+    // remove ML thread from L stack
+    lua_remove(L, -2);
+    return 1;
+}
+static void require_config_init(luarequire_Configuration* config) {
+    requireConfigInit(config);
+    config->load = load;
+}
 
 // yanked from Repl.h
 static auto create_require_context(lua_State* L) -> void*
@@ -21,7 +98,7 @@ static auto create_require_context(lua_State* L) -> void*
     ctx = new (ctx) ReplRequirer{
         compile_options<Luau::CompileOptions>,
         coverageActive,
-        []{return true;},
+        []{return active_build_settings().codegen;},
         coverageTrack,
     };
 
@@ -33,6 +110,63 @@ static auto create_require_context(lua_State* L) -> void*
 
     return ctx;
 }
+void invalidate_stale_modules(lua_State* L) {
+    auto& modules = get_runtime(L).modules;
+    auto const stale = std::ranges::any_of(modules, [](auto const& entry) {
+        auto ec = std::error_code{};
+        return std::filesystem::last_write_time(entry.first, ec) != entry.second or ec;
+    });
+    if (not stale) return;
+    // modules may capture each other, so every cached result goes.
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, module_cache_key);
+    modules.clear();
+}
+// every module is read, compiled and scanned on the pool, the modules it
+// requires are queued as soon as they are resolved.
+namespace {
+struct prefetch_graph {
+    lua_CompileOptions options = compile_options();
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::unordered_set<std::string> seen;
+    std::size_t outstanding = 0;
+
+    void visit(std::filesystem::path file) {
+        {
+            auto lock = std::scoped_lock{mutex};
+            if (not seen.insert(file.string()).second) return;
+            ++outstanding;
+        }
+        worker_pool::shared().submit([this, file = std::move(file)] {
+            // only a warm up, failures are left to the require that runs into them.
+            try {
+                if (auto const source = read_file(file)) {
+                    bytecode_cache::compile_shared(file, *source, options);
+                    for (auto const& request : resolve::requires_of(*source)) {
+                        // unresolved modules are left to report their error when required.
+                        if (auto const resolved = resolve::module(file, request)) visit(*resolved);
+                    }
+                }
+            } catch (std::exception const&) {}
+            auto lock = std::scoped_lock{mutex};
+            if (--outstanding == 0) finished.notify_all();
+        });
+    }
+    void wait() {
+        auto lock = std::unique_lock{mutex};
+        finished.wait(lock, [this] {return outstanding == 0;});
+    }
+};
+}
+void prefetch_modules(std::span<std::filesystem::path const> entries) {
+    auto graph = prefetch_graph{};
+    for (auto const& entry : entries) {
+        auto ec = std::error_code{};
+        graph.visit(std::filesystem::weakly_canonical(entry, ec));
+    }
+    graph.wait();
+}
 void open_require(lua_State* L) {
-    luaopen_require(L, requireConfigInit, create_require_context(L));
+    luaopen_require(L, require_config_init, create_require_context(L));
 }
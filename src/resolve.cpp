@@ -0,0 +1,102 @@
+#include "resolve.hpp"
+#include "export.hpp"
+#include <Luau/Ast.h>
+#include <Luau/Parser.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <format>
+#include <optional>
+namespace fs = std::filesystem;
+using namespace std::string_view_literals;
+
+namespace {
+struct require_finder : Luau::AstVisitor {
+    std::vector<std::string> found;
+    auto visit(Luau::AstExprCall* call) -> bool override {
+        auto const global = call->func->as<Luau::AstExprGlobal>();
+        if (not global or global->name != "require" or call->args.size != 1) return true;
+        if (auto const literal = call->args.data[0]->as<Luau::AstExprConstantString>()) {
+            found.emplace_back(literal->value.data, literal->value.size);
+        }
+        return true;
+    }
+};
+auto lowercase(std::string_view s) -> std::string {
+    auto out = std::string{s};
+    std::ranges::transform(out, out.begin(), [](unsigned char c) {return std::tolower(c);});
+    return out;
+}
+// the first .luaurc from dir upwards that defines the alias decides it,
+// alias values are relative to the directory of their .luaurc.
+auto find_alias(fs::path dir, std::string_view alias) -> std::optional<fs::path> {
+    auto const name = lowercase(alias);
+    for (auto ec = std::error_code{}; not dir.empty(); dir = dir.parent_path()) {
+        auto const rc = dir / ".luaurc";
+        if (fs::is_regular_file(rc, ec)) {
+            if (auto const contents = read_file(rc)) {
+                auto const config = nlohmann::json::parse(*contents, nullptr, false, true);
+                if (config.is_object() and config.contains("aliases") and config["aliases"].is_object()) {
+                    for (auto const& [key, value] : config["aliases"].items()) {
+                        if (lowercase(key) == name and value.is_string()) return dir / value.get<std::string>();
+                    }
+                }
+            }
+        }
+        if (dir == dir.parent_path()) break;
+    }
+    return std::nullopt;
+}
+auto find_file(fs::path const& base) -> std::optional<fs::path> {
+    auto ec = std::error_code{};
+    for (auto const extension : {".luau"sv, ".lua"sv}) {
+        auto candidate = base;
+        candidate += extension;
+        if (fs::is_regular_file(candidate, ec)) return fs::weakly_canonical(candidate, ec);
+    }
+    for (auto const init : {"init.luau"sv, "init.lua"sv}) {
+        auto const candidate = base / init;
+        if (fs::is_regular_file(candidate, ec)) return fs::weakly_canonical(candidate, ec);
+    }
+    return std::nullopt;
+}
+}
+auto resolve::requires_of(std::string_view source) -> std::vector<std::string> {
+    auto allocator = Luau::Allocator{};
+    auto names = Luau::AstNameTable{allocator};
+    auto const result = Luau::Parser::parse(source.data(), source.size(), names, allocator, {});
+    auto finder = require_finder{};
+    if (result.root) result.root->visit(&finder);
+    return std::move(finder.found);
+}
+auto resolve::module(fs::path const& from, std::string_view request) -> std::expected<fs::path, std::string> {
+    // init files stand in for their directory, ./ then means its siblings.
+    auto const self = from.parent_path();
+    auto const is_init = from.stem() == "init";
+    auto base = fs::path{};
+    auto rest = request;
+    if (rest.starts_with("./") or rest.starts_with("../")) {
+        base = is_init ? self.parent_path() : self;
+    } else if (rest.starts_with('@')) {
+        auto const slash = rest.find('/');
+        auto const alias = rest.substr(1, slash == std::string_view::npos ? rest.npos : slash - 1);
+        rest = slash == std::string_view::npos ? ""sv : rest.substr(slash + 1);
+        if (alias == "self") {
+            // a module is its own directory, a/b.luau requires a/b/c as @self/c.
+            base = is_init ? self : fs::path{from}.replace_extension();
+        } else if (auto const found = find_alias(self, alias)) {
+            base = *found;
+        } else {
+            return std::unexpected(std::format("unknown alias '@{}' in '{}'", alias, request));
+        }
+    } else {
+        return std::unexpected(std::format("require path '{}' must start with ./, ../ or an @alias", request));
+    }
+    auto const target = rest.empty() ? base : base / rest;
+    if (auto const file = find_file(target.lexically_normal())) return *file;
+    // an alias may point straight at a file.
+    auto ec = std::error_code{};
+    if (rest.empty() and fs::is_regular_file(base, ec)) return fs::weakly_canonical(base, ec);
+    return std::unexpected(std::format("could not resolve '{}' from '{}'", request, from.string()));
+}
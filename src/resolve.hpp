@@ -0,0 +1,17 @@
+#pragma once
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// static module resolution, mirrors what require does at runtime without
+// running anything. used where the require graph is needed up front.
+namespace resolve {
+// string literals passed to require in the source, in order of appearance.
+// requires with computed arguments can not be resolved statically.
+auto requires_of(std::string_view source) -> std::vector<std::string>;
+// file the require string names when required from the module at from.
+// handles ./ and ../, @self and the aliases of .luaurc files above from.
+auto module(std::filesystem::path const& from, std::string_view request) -> std::expected<std::filesystem::path, std::string>;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <lua.h>
+#include "locked_stream.hpp"
+#include "scheduler.hpp"
+#include "profiler.hpp"
+#include "allocator.hpp"
+
+// memory categories threads allocate under, see lua_setmemcat.
+enum class memory_category : int {
+    runtime,
+    script,
+    modules,
+};
+constexpr auto memory_category_names = std::to_array<const char*>({
+    "runtime",
+    "script",
+    "modules",
+});
+// collections driven through collectgarbage are always timed, automatic
+// cycles are only observed through the gc interrupt while tracing.
+struct gc_stats {
+    using clock = std::chrono::steady_clock;
+    bool tracing = false;
+    std::uint64_t collections{};
+    double collect_seconds{};
+    double last_collect_seconds{};
+    std::uint64_t steps{};
+    double step_seconds{};
+    std::uint64_t cycles{};
+    double cycle_seconds{};
+    double last_cycle_seconds{};
+    bool in_cycle = false;
+    clock::time_point cycle_start{};
+    clock::time_point last_step{};
+};
+// filled when the state is created and by the first script it loads.
+struct startup_stats {
+    double state_seconds{};
+    double setup_seconds{};
+    double first_load_seconds{};
+    double library_seconds{};
+    int libraries_loaded{};
+    bool loaded_script = false;
+};
+using interrupt_callback = void(*)(lua_State* L, int gc);
+// host side data owned by a state, reachable from any of its threads
+// through lua_callbacks(L)->userdata.
+struct runtime {
+    std::ostream* out = &std::cout;
+    std::ostream* err = &std::cerr;
+    std::istream* in = &std::cin;
+    scheduler tasks{};
+    // call stack samples, only set while the profiler is running.
+    profiler::samples* profiling = nullptr;
+    // byte counters of the state allocator, must outlive the state.
+    allocator::heap heap{};
+    gc_stats gc{};
+    // live objects per userdata tag of lua::type<T>.
+    std::array<std::int64_t, LUA_UTAG_LIMIT> live_userdata{};
+    // interrupt installed while the profiler is not waiting on a sample.
+    interrupt_callback base_interrupt = nullptr;
+    startup_stats startup{};
+    // source files of loaded modules with their mtime when they were loaded.
+    std::unordered_map<std::string, std::filesystem::file_time_type> modules;
+    // native threads of the workers spawned through wow.thread, joined before
+    // the state closes. stopping them wakes up workers blocked on a channel.
+    std::vector<std::jthread> workers;
+    // what out and err point to, the streams given to init_state behind a lock.
+    std::unique_ptr<locked_stream> locked_out;
+    std::unique_ptr<locked_stream> locked_err;
+};
+inline auto get_runtime(lua_State* L) -> runtime& {
+    return *static_cast<runtime*>(lua_callbacks(L)->userdata);
+}
+inline void set_memory_category(lua_State* thread, memory_category category) {
+    lua_setmemcat(thread, static_cast<int>(category));
+}
+// pushes a table of the allocated bytes per memory category.
+inline void push_memory_categories(lua_State* L) {
+    lua_createtable(L, 0, memory_category_names.size());
+    for (int i{}; i < memory_category_names.size(); ++i) {
+        lua_pushnumber(L, static_cast<double>(lua_totalbytes(L, i)));
+        lua_setfield(L, -2, memory_category_names[i]);
+    }
+}
@@ -0,0 +1,279 @@
+#include "scheduler.hpp"
+#include "runtime.hpp"
+#include "lua/lua.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <format>
+#include <thread>
+#include <lualib.h>
+namespace rgs = std::ranges;
+using sec_t = std::chrono::duration<double>;
+
+auto scheduler::track(lua_State* L, int idx) -> std::uint64_t {
+    auto const thread = lua_tothread(L, idx);
+    auto const id = ++next_id_;
+    if (auto found = pending_.find(thread); found != pending_.end()) {
+        found->second.id = id;
+    } else {
+        pending_.emplace(thread, handle{.ref = lua_ref(L, idx), .id = id});
+    }
+    return id;
+}
+void scheduler::release(lua_State* L, lua_State* thread) {
+    auto found = pending_.find(thread);
+    if (found == pending_.end()) return;
+    lua_unref(L, found->second.ref);
+    pending_.erase(found);
+}
+auto scheduler::is_current(task const& t) const -> bool {
+    auto found = pending_.find(t.thread);
+    return found != pending_.end() and found->second.id == t.id;
+}
+auto scheduler::resume(lua_State* L, task const& t) -> bool {
+    auto nargs = t.nargs;
+    if (t.pass_elapsed) {
+        lua_pushnumber(t.thread, sec_t{clock::now() - t.since}.count());
+        ++nargs;
+    }
+    return finish(L, t, lua_resume(t.thread, L, nargs));
+}
+auto scheduler::finish(lua_State* L, task const& t, int status) -> bool {
+    auto const ok = status == LUA_OK or status == LUA_YIELD;
+    if (not ok) {
+        *get_runtime(L).err << std::format("\033[35mError: {}\033[0m\n", lua::tostring(t.thread, -1));
+    }
+    // the thread did not schedule itself again while it was running.
+    if (is_current(t)) release(L, t.thread);
+    return ok;
+}
+auto scheduler::to_tick(clock::time_point time) const -> std::uint64_t {
+    if (time <= origin_) return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time - origin_) / tick_length;
+}
+void scheduler::advance(clock::time_point now) {
+    auto const target = to_tick(now);
+    if (target < current_tick_) return;
+    auto fired = std::vector<timer>{};
+    if (timer_count_ > 0) {
+        auto const steps = std::min<std::uint64_t>(target - current_tick_ + 1, wheel_size);
+        for (std::uint64_t i{}; i < steps; ++i) {
+            auto& slot = wheel_[(current_tick_ + i) % wheel_size];
+            auto const due = rgs::partition(slot, [&](timer const& e) {
+                return e.tick > target;
+            });
+            rgs::move(due, std::back_inserter(fired));
+            slot.erase(due.begin(), due.end());
+        }
+        timer_count_ -= fired.size();
+    }
+    current_tick_ = target + 1;
+    rgs::sort(fired, [](timer const& a, timer const& b) {
+        return a.deadline != b.deadline ? a.deadline < b.deadline : a.entry.id < b.entry.id;
+    });
+    for (auto const& e : fired) {
+        if (is_current(e.entry)) ready_.push_back(e.entry);
+    }
+}
+auto scheduler::next_deadline() -> clock::time_point {
+    // timers of threads that were cancelled or rescheduled are dropped lazily.
+    while (not deadlines_.empty() and not is_current(deadlines_.top().entry)) deadlines_.pop();
+    return deadlines_.empty() ? clock::time_point::max() : deadlines_.top().deadline;
+}
+auto scheduler::spawn(lua_State* L, int idx, int nargs) -> bool {
+    auto const id = track(L, idx);
+    return resume(L, {
+        .thread = lua_tothread(L, idx),
+        .id = id,
+        .nargs = nargs,
+        .pass_elapsed = false,
+        .since = clock::now(),
+    });
+}
+void scheduler::defer(lua_State* L, int idx, int nargs) {
+    auto const id = track(L, idx);
+    ready_.push_back({
+        .thread = lua_tothread(L, idx),
+        .id = id,
+        .nargs = nargs,
+        .pass_elapsed = false,
+        .since = clock::now(),
+    });
+}
+void scheduler::delay(lua_State* L, int idx, double seconds, int nargs, bool pass_elapsed) {
+    auto const id = track(L, idx);
+    auto const now = clock::now();
+    auto const deadline = now + std::chrono::ceil<clock::duration>(sec_t{std::max(seconds, 0.0)});
+    // round up so a timer never fires before its deadline.
+    auto const tick = std::max(to_tick(deadline + tick_length - clock::duration{1}), current_tick_);
+    auto const t = timer{
+        .entry = {
+            .thread = lua_tothread(L, idx),
+            .id = id,
+            .nargs = nargs,
+            .pass_elapsed = pass_elapsed,
+            .since = now,
+        },
+        .deadline = deadline,
+        .tick = tick,
+    };
+    wheel_[tick % wheel_size].push_back(t);
+    deadlines_.push(t);
+    ++timer_count_;
+}
+auto scheduler::wait(lua_State* L, double seconds) -> int {
+    // yielding out of a user coroutine would return to its resume.
+    if (not owns(L)) {
+        auto const start = clock::now();
+        std::this_thread::sleep_for(sec_t{seconds});
+        return lua::push(L, sec_t{clock::now() - start}.count());
+    }
+    lua_pushthread(L);
+    delay(L, -1, seconds, 0, true);
+    lua_pop(L, 1);
+    return lua_yield(L, 0);
+}
+auto scheduler::cancel(lua_State* L, int idx) -> bool {
+    auto const thread = lua_tothread(L, idx);
+    auto const found = pending_.contains(thread);
+    release(L, thread);
+    return found;
+}
+void scheduler::set_blocking(lua_State* thread, bool blocking) {
+    if (blocking) blocking_.insert(thread);
+    else blocking_.erase(thread);
+}
+auto scheduler::can_yield(lua_State* L) const -> bool {
+    return lua_isyieldable(L) and not blocking_.contains(L);
+}
+auto scheduler::owns(lua_State* L) const -> bool {
+    // released threads are left to whoever resumes them next.
+    return can_yield(L) and pending_.contains(L);
+}
+auto scheduler::fail(std::string message) -> continuation {
+    return [message = std::move(message)](lua_State* L) {
+        lua::push(L, message);
+        return raise;
+    };
+}
+auto scheduler::settle(lua_State* L, continuation resume) -> int {
+    auto const nresults = resume(L);
+    if (nresults == raise) lua_error(L);
+    return nresults;
+}
+void scheduler::inbox::post(completion c) {
+    {
+        auto lock = std::scoped_lock{mutex};
+        done.push_back(std::move(c));
+        --outstanding;
+    }
+    posted.notify_all();
+}
+void scheduler::inbox::wake(completion c) {
+    {
+        auto lock = std::scoped_lock{mutex};
+        done.push_back(std::move(c));
+    }
+    posted.notify_all();
+}
+auto scheduler::park(lua_State* L, std::move_only_function<void(waker)> enqueue) -> int {
+    lua_pushthread(L);
+    auto const id = track(L, -1);
+    auto const job = ++next_job_;
+    in_flight_.emplace(job, lua_ref(L, -1));
+    lua_pop(L, 1);
+    parked_.emplace(job, task{.thread = L, .id = id, .nargs = 0, .pass_elapsed = false});
+    enqueue([target = inbox_, thread = L, id, job](continuation resume) {
+        target->wake({
+            .thread = thread,
+            .id = id,
+            .job = job,
+            .resume = std::move(resume),
+        });
+    });
+    return lua_yield(L, 0);
+}
+auto scheduler::has_parked() const -> bool {
+    // cancelled threads are not waited for.
+    return rgs::any_of(parked_, [this](auto const& e) {return is_current(e.second);});
+}
+auto scheduler::submit(lua_State* L, std::move_only_function<continuation()> work) -> int {
+    lua_pushthread(L);
+    auto const id = track(L, -1);
+    // pins the thread, and with it the arguments of the call, until the work completed.
+    auto const job = ++next_job_;
+    in_flight_.emplace(job, lua_ref(L, -1));
+    lua_pop(L, 1);
+    {
+        auto lock = std::scoped_lock{inbox_->mutex};
+        ++inbox_->outstanding;
+    }
+    worker_pool::shared().submit([target = inbox_, thread = L, id, job, work = std::move(work)]() mutable {
+        target->post({
+            .thread = thread,
+            .id = id,
+            .job = job,
+            .resume = work(),
+        });
+    });
+    return lua_yield(L, 0);
+}
+auto scheduler::complete(lua_State* L) -> bool {
+    auto done = std::vector<completion>{};
+    {
+        auto lock = std::scoped_lock{inbox_->mutex};
+        done.swap(inbox_->done);
+    }
+    auto ok = true;
+    for (auto& c : done) {
+        auto const t = task{.thread = c.thread, .id = c.id, .nargs = 0, .pass_elapsed = false};
+        if (is_current(t)) {
+            auto const nresults = c.resume(c.thread);
+            auto const status = nresults == raise
+                ? lua_resumeerror(c.thread, L)
+                : lua_resume(c.thread, L, nresults);
+            ok = finish(L, t, status) and ok;
+        }
+        if (auto pin = in_flight_.find(c.job); pin != in_flight_.end()) {
+            lua_unref(L, pin->second);
+            in_flight_.erase(pin);
+        }
+        parked_.erase(c.job);
+    }
+    return ok;
+}
+void scheduler::drain() {
+    auto unclaimed = std::vector<completion>{};
+    auto lock = std::unique_lock{inbox_->mutex};
+    inbox_->posted.wait(lock, [this] {return inbox_->outstanding == 0;});
+    // continuations may hold references into the state, they are dropped
+    // here while it is still open rather than with the scheduler.
+    unclaimed.swap(inbox_->done);
+}
+auto scheduler::run(lua_State* L) -> bool {
+    auto ok = true;
+    while (not empty()) {
+        ok = complete(L) and ok;
+        advance(clock::now());
+        if (ready_.empty()) {
+            auto const deadline = next_deadline();
+            auto lock = std::unique_lock{inbox_->mutex};
+            auto const has_completions = [this] {return not inbox_->done.empty();};
+            if (has_completions()) continue;
+            // nothing left that could ever resume the pending threads.
+            if (deadline == clock::time_point::max() and inbox_->outstanding == 0 and not has_parked()) break;
+            profiler::idle_begin(L);
+            if (deadline == clock::time_point::max()) {
+                inbox_->posted.wait(lock, has_completions);
+            } else {
+                inbox_->posted.wait_until(lock, deadline, has_completions);
+            }
+            profiler::idle_end(L);
+            continue;
+        }
+        auto batch = std::exchange(ready_, {});
+        for (auto const& t : batch) {
+            if (is_current(t)) ok = resume(L, t) and ok;
+        }
+    }
+    return ok;
+}
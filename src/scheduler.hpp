@@ -0,0 +1,152 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+struct lua_State;
+
+// resumes yielded threads of a single state until none are left.
+// delayed resumptions are kept in a hashed timer wheel with millisecond ticks,
+// blocking work is offloaded to the shared worker pool.
+class scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+    // pushes the results of offloaded work onto the thread it resumes and
+    // returns their count, or returns raise after pushing an error value.
+    using continuation = std::move_only_function<int(lua_State*)>;
+    static constexpr int raise = -1;
+    static auto fail(std::string message) -> continuation;
+
+    // the thread to schedule lives at idx on the stack of L, the nargs
+    // values to resume it with are already pushed onto the thread itself.
+
+    // resumes the thread right away.
+    auto spawn(lua_State* L, int idx, int nargs) -> bool;
+    // resumes the thread on the next cycle.
+    void defer(lua_State* L, int idx, int nargs);
+    // resumes the thread once the delay elapsed, passing the elapsed seconds
+    // as an extra argument when pass_elapsed is set.
+    void delay(lua_State* L, int idx, double seconds, int nargs, bool pass_elapsed = false);
+    // yields the running thread for the given amount of seconds, or blocks
+    // the native thread when the scheduler does not own it.
+    auto wait(lua_State* L, double seconds) -> int;
+    auto cancel(lua_State* L, int idx) -> bool;
+    // runs work on the shared worker pool and yields the running thread until
+    // its continuation is ready. runs inline unless the scheduler owns the
+    // thread, yielding out of a user coroutine would return to its resume.
+    // values on the stack of the running thread stay alive until then.
+    template <std::invocable Work>
+    requires std::convertible_to<std::invoke_result_t<Work>, continuation>
+    auto await(lua_State* L, Work work) -> int {
+        if (not owns(L)) return settle(L, guarded(work));
+        return submit(L, [work = std::move(work)]() mutable -> continuation {
+            return guarded(work);
+        });
+    }
+    // resumes a parked thread with its continuation, from any native thread.
+    using waker = std::move_only_function<void(continuation)>;
+    // yields the running thread, which must be owned, until the waker handed
+    // to enqueue is called. unlike await no thread of the pool is held while
+    // it waits. values on the stack of the running thread stay alive until then.
+    auto park(lua_State* L, std::move_only_function<void(waker)> enqueue) -> int;
+    // threads resumed by the host in a way that does not allow yielding,
+    // such as module threads of require.
+    void set_blocking(lua_State* thread, bool blocking);
+    auto can_yield(lua_State* L) const -> bool;
+    // whether the thread was scheduled through spawn, defer or delay and
+    // is only ever resumed by the scheduler.
+    auto owns(lua_State* L) const -> bool;
+    // runs until no scheduled threads are left, returns false when any of them errored.
+    auto run(lua_State* L) -> bool;
+    // blocks until all offloaded work finished and drops the continuations
+    // nothing claimed, must be called before closing the state.
+    void drain();
+    auto empty() const -> bool {return pending_.empty() and in_flight_.empty();}
+private:
+    struct task {
+        lua_State* thread;
+        std::uint64_t id;
+        int nargs;
+        bool pass_elapsed;
+        clock::time_point since;
+    };
+    struct timer {
+        task entry;
+        clock::time_point deadline;
+        std::uint64_t tick;
+    };
+    struct later_deadline {
+        auto operator()(timer const& a, timer const& b) const -> bool {return a.deadline > b.deadline;}
+    };
+    struct handle {
+        int ref;
+        std::uint64_t id;
+    };
+    struct completion {
+        lua_State* thread;
+        std::uint64_t id;
+        std::uint64_t job;
+        continuation resume;
+    };
+    // shared with the pool so late completions never outlive their target.
+    struct inbox {
+        std::mutex mutex;
+        std::condition_variable posted;
+        std::vector<completion> done;
+        std::size_t outstanding = 0;
+        void post(completion c);
+        // like post for a parked thread, which is not counted as outstanding.
+        void wake(completion c);
+    };
+    static constexpr std::size_t wheel_size = 256;
+    static constexpr auto tick_length = std::chrono::milliseconds{1};
+
+    template <typename Work>
+    static auto guarded(Work& work) -> continuation {
+        try {
+            return work();
+        } catch (std::exception const& e) {
+            return fail(e.what());
+        }
+    }
+    static auto settle(lua_State* L, continuation resume) -> int;
+    auto submit(lua_State* L, std::move_only_function<continuation()> work) -> int;
+    auto track(lua_State* L, int idx) -> std::uint64_t;
+    void release(lua_State* L, lua_State* thread);
+    auto is_current(task const& t) const -> bool;
+    auto resume(lua_State* L, task const& t) -> bool;
+    auto finish(lua_State* L, task const& t, int status) -> bool;
+    auto complete(lua_State* L) -> bool;
+    auto to_tick(clock::time_point time) const -> std::uint64_t;
+    void advance(clock::time_point now);
+    auto next_deadline() -> clock::time_point;
+    auto has_parked() const -> bool;
+
+    std::unordered_map<lua_State*, handle> pending_;
+    std::unordered_set<lua_State*> blocking_;
+    std::unordered_map<std::uint64_t, int> in_flight_;
+    // threads waiting on a waker by their job, run keeps waiting for them.
+    std::unordered_map<std::uint64_t, task> parked_;
+    std::shared_ptr<inbox> inbox_ = std::make_shared<inbox>();
+    std::deque<task> ready_;
+    std::array<std::vector<timer>, wheel_size> wheel_;
+    // the same timers ordered by deadline, so idle turns find the next one
+    // without scanning the wheel.
+    std::priority_queue<timer, std::vector<timer>, later_deadline> deadlines_;
+    std::size_t timer_count_ = 0;
+    std::uint64_t current_tick_ = 0;
+    std::uint64_t next_id_ = 0;
+    std::uint64_t next_job_ = 0;
+    clock::time_point origin_ = clock::now();
+};
@@ -3,10 +3,16 @@
 #include <luacode.h>
 #include <Luau/CodeGen.h>
 #include <Luau/Require.h>
+#include <Luau/Coverage.h>
 #include <fstream>
 #include <filesystem>
 #include <expected>
+#include <chrono>
+#include <print>
+#include <span>
 #include "export.hpp"
+#include "bytecode_cache.hpp"
+#include "bundle.hpp"
 #include "lua.h"
 #include "comptime.hpp"
 #include "named_atom.hpp"
@@ -20,82 +26,296 @@ static auto loadstring(lua_State* L) -> int {
     auto s = luaL_checklstring(L, 1, &l);
     auto chunkname = luaL_optstring(L, 2, s);
     lua_setsafeenv(L, LUA_ENVIRONINDEX, false);
-    auto bytecode = lua::compile({s, l}, compile_options());
+    auto bytecode = bytecode_cache::compile({s, l}, compile_options());
 
-    return *lua::load(L, bytecode, {.chunkname = chunkname})
+    return *lua::load(L, bytecode, {
+        .codegen = active_build_settings().codegen,
+        .chunkname = chunkname,
+        .userdata_types = userdata_types::names(),
+    })
     .transform([] {
         return 1;
     }).transform_error([&](std::string err) {
         return lua::push_tuple(L, lua::nil, err);
     });
 }
-static int collectgarbage(auto L) {
+static auto print(lua_State* L) -> int {
+    auto& out = *get_runtime(L).out;
+    const int top = lua_gettop(L);
+    for (int i{1}; i <= top; ++i) {
+        if (i > 1) out << '\t';
+        out << lua::tostring(L, i);
+        lua_pop(L, 1);
+    }
+    out << '\n';
+    return lua::none;
+}
+using gc_seconds = std::chrono::duration<double>;
+// GCSpause of lgc.h, the interrupt receives the state a gc step started in.
+constexpr auto gc_pause_state = 0;
+static void observe_gc(lua_State* L, int gc) {
+    if (gc < 0) return;
+    auto& stats = get_runtime(L).gc;
+    auto const now = gc_stats::clock::now();
+    if (gc == gc_pause_state) {
+        // the previous cycle ended with the last step before this one.
+        if (stats.in_cycle) {
+            stats.last_cycle_seconds = gc_seconds{stats.last_step - stats.cycle_start}.count();
+            stats.cycle_seconds += stats.last_cycle_seconds;
+            ++stats.cycles;
+        }
+        stats.in_cycle = true;
+        stats.cycle_start = now;
+    }
+    stats.last_step = now;
+}
+static void set_gc_tracing(lua_State* L, bool enabled) {
+    auto& rt = get_runtime(L);
+    rt.gc.tracing = enabled;
+    rt.gc.in_cycle = false;
+    rt.base_interrupt = enabled ? observe_gc : nullptr;
+    lua_callbacks(L)->interrupt = rt.base_interrupt;
+}
+static void count_userdata(lua_State* L, int tag, int delta) {
+    get_runtime(L).live_userdata[tag] += delta;
+}
+static void push_gc_stats(lua_State* L) {
+    auto const& rt = get_runtime(L);
+    auto const& gc = rt.gc;
+    lua_createtable(L, 0, 4);
+    lua::push(L, static_cast<double>(lua_totalbytes(L, -1)));
+    lua_setfield(L, -2, "total");
+    push_memory_categories(L);
+    lua_setfield(L, -2, "categories");
+    lua_newtable(L);
+    for (auto names = userdata_types::names(); *names; ++names) {
+        lua::push(L, static_cast<double>(rt.live_userdata[userdata_types::tag(*names)]));
+        lua_setfield(L, -2, *names);
+    }
+    lua_setfield(L, -2, "userdata");
+    lua_createtable(L, 0, 10);
+    lua_pushboolean(L, lua_gc(L, LUA_GCISRUNNING, 0));
+    lua_setfield(L, -2, "running");
+    lua_pushboolean(L, gc.tracing);
+    lua_setfield(L, -2, "tracing");
+    auto const fields = std::to_array<std::pair<const char*, double>>({
+        {"collections", static_cast<double>(gc.collections)},
+        {"collect_time", gc.collect_seconds},
+        {"last_collect_time", gc.last_collect_seconds},
+        {"steps", static_cast<double>(gc.steps)},
+        {"step_time", gc.step_seconds},
+        {"cycles", static_cast<double>(gc.cycles)},
+        {"cycle_time", gc.cycle_seconds},
+        {"last_cycle_time", gc.last_cycle_seconds},
+    });
+    for (auto const& [name, value] : fields) {
+        lua::push(L, value);
+        lua_setfield(L, -2, name);
+    }
+    lua_setfield(L, -2, "gc");
+}
+static auto collectgarbage(lua_State* L) -> int {
     std::string_view option = luaL_optstring(L, 1, "collect");
+    auto& stats = get_runtime(L).gc;
+    auto const timed = [](auto&& fn) {
+        auto const start = gc_stats::clock::now();
+        auto result = fn();
+        return std::pair{result, gc_seconds{gc_stats::clock::now() - start}.count()};
+    };
     if (option == "collect") {
-        lua_gc(L, LUA_GCCOLLECT, 0);
+        auto const [_, seconds] = timed([L] {return lua_gc(L, LUA_GCCOLLECT, 0);});
+        ++stats.collections;
+        stats.collect_seconds += seconds;
+        stats.last_collect_seconds = seconds;
+        // a full collection restarts the automatic cycle.
+        stats.in_cycle = false;
         return lua::none;
     } else if (option == "count") {
-        int count = lua_gc(L, LUA_GCCOUNT, 0);
-        return lua::push(L, count);
+        auto const kilobytes = lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0;
+        return lua::push(L, kilobytes);
+    } else if (option == "step") {
+        auto const kilobytes = static_cast<int>(luaL_optinteger(L, 2, 0));
+        auto const [finished, seconds] = timed([=] {return lua_gc(L, LUA_GCSTEP, kilobytes);});
+        ++stats.steps;
+        stats.step_seconds += seconds;
+        lua_pushboolean(L, finished);
+        return 1;
+    } else if (option == "stop") {
+        lua_gc(L, LUA_GCSTOP, 0);
+        return lua::none;
+    } else if (option == "restart") {
+        lua_gc(L, LUA_GCRESTART, 0);
+        return lua::none;
+    } else if (option == "isrunning") {
+        lua_pushboolean(L, lua_gc(L, LUA_GCISRUNNING, 0));
+        return 1;
+    } else if (option == "setgoal" or option == "setstepmul" or option == "setstepsize") {
+        auto const what = option == "setgoal" ? LUA_GCSETGOAL
+            : option == "setstepmul" ? LUA_GCSETSTEPMUL
+            : LUA_GCSETSTEPSIZE;
+        auto const previous = lua_gc(L, what, static_cast<int>(luaL_checkinteger(L, 2)));
+        return lua::push(L, previous);
+    } else if (option == "trace") {
+        set_gc_tracing(L, luaL_optboolean(L, 2, true));
+        return lua::none;
+    } else if (option == "stats") {
+        push_gc_stats(L);
+        return 1;
     }
-    luaL_error(L, "collectgarbage must be called with 'count' or 'collect'");
+    luaL_errorL(L, "invalid option '%s' for collectgarbage", option.data());
 }
 static auto useratom(const char* str, size_t len) -> int16_t {
-    std::string_view namecall{str, len};
-    static constexpr auto info = comptime::to_array<named_atom>();
-    auto found = rgs::find_if(info, [&namecall](auto const& e) {
-        return e.name == namecall;
-    });
-    if (found == rgs::end(info)) return -1;
-    return static_cast<int16_t>(found->value);
+    return static_cast<int16_t>(comptime::perfect_hash<named_atom>::find({str, len}));
 }
 
 auto load_script(lua_State* L, const std::filesystem::path& path) -> std::expected<lua_State*, std::string> {
     auto main_thread = lua_mainthread(L);
     auto script_thread = lua_newthread(main_thread);
     luaL_sandboxthread(script_thread);
-    std::ifstream file{path};
-    if (!file.is_open()) {
+    set_memory_category(script_thread, memory_category::script);
+    auto source = read_file(path);
+    if (!source) {
         return std::unexpected(std::format("failed to open {}", path.string()));
     }
-    std::string line, contents;
-    while (std::getline(file, line)) contents.append(line + '\n');
+    auto const bytecode = bytecode_cache::compile_shared(path, *source, compile_options());
 
-    return lua::compile_and_load(script_thread, contents, compile_options(), {
-        .chunkname = std::format("@{}", std::filesystem::absolute(path).replace_extension().generic_string())
+    return lua::load(script_thread, *bytecode, {
+        .codegen = active_build_settings().codegen,
+        .chunkname = std::format("@{}", std::filesystem::absolute(path).replace_extension().generic_string()),
+        .userdata_types = userdata_types::names(),
     }).transform([&] {
+        if (coverageActive()) coverageTrack(script_thread, -1);
         return script_thread;
     }).transform_error([](auto err) {
         return std::format("Loading error: {}", err);
     });
 }
-auto init_state(const char* libname) -> lua::state_owner {
+// resumes the loaded script with the arguments, then everything it scheduled.
+static auto resume_script(lua_State* L, std::expected<lua_State*, std::string> const& thread, std::span<std::string_view const> args) -> bool {
+    auto& rt = get_runtime(L);
+    if (not thread) {
+        std::println(*rt.err, "\033[35mError: {}\033[0m", thread.error());
+        return false;
+    }
+    for (auto arg : args) lua_pushlstring(*thread, arg.data(), arg.size());
+    // spawned so the scheduler owns the entry thread like any task.
+    lua_pushthread(*thread);
+    lua_xmove(*thread, L, 1);
+    auto const started = rt.tasks.spawn(L, -1, static_cast<int>(args.size()));
+    lua_pop(L, 1);
+    if (not started) return false;
+    // keep resuming whatever the script scheduled until nothing is left.
+    return rt.tasks.run(L);
+}
+auto run_script(lua_State* L, std::filesystem::path const& script, std::span<std::string_view const> args) -> bool {
+    auto& rt = get_runtime(L);
+    auto const start = std::chrono::steady_clock::now();
+    lib::fs::reset_stat_cache(L);
+    auto thread = load_script(L, script);
+    if (not rt.startup.loaded_script) {
+        rt.startup.loaded_script = true;
+        rt.startup.first_load_seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+    }
+    return resume_script(L, thread, args);
+}
+auto run_bundle(lua_State* L, bundle::image const& bundle, std::span<std::string_view const> args) -> bool {
+    lib::fs::reset_stat_cache(L);
+    return resume_script(L, bundle::load_entry(L, bundle), args);
+}
+static auto remap_userdata_type(void*, const char* name, size_t len) -> uint8_t {
+    auto const tag = userdata_types::tag({name, len});
+    return tag < 0 ? UINT8_MAX : static_cast<uint8_t>(tag);
+}
+static void close_state(lua_State* L) {
+    auto rt = &get_runtime(L);
+    rt->workers.clear();
+    rt->tasks.drain();
+    profiler::detach(L);
+    lua_close(L);
+    delete rt;
+}
+struct library_entry {
+    const char* name;
+    loader load;
+};
+static constexpr auto libraries = std::to_array<library_entry>({
+    {"fs", lib::fs::library},
+    {"http", lib::http::library},
+    {"json", lib::json::library},
+    {"proc", lib::proc::library},
+    {"io", lib::io::library},
+    {"task", lib::task::library},
+    {"bench", lib::bench::library},
+    {"thread", lib::thread::library},
+    {"shm", lib::shm::library},
+});
+// __index of wow, builds a library on first access and stores it in wow.
+static auto load_library(lua_State* L) -> int {
+    std::string_view const name = luaL_checkstring(L, 2);
+    auto const found = rgs::find_if(libraries, [&](library_entry const& e) {
+        return e.name == name;
+    });
+    if (found == libraries.end()) return lua::none;
+    auto& startup = get_runtime(L).startup;
+    auto const start = std::chrono::steady_clock::now();
+    lua_newtable(L);
+    found->load(L, -2);
+    // shared by every script the state runs.
+    lua_setreadonly(L, -1, true);
+    lua_setreadonly(L, 1, false);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, 1, found->name);
+    lua_setreadonly(L, 1, true);
+    startup.library_seconds += std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+    ++startup.libraries_loaded;
+    return 1;
+}
+void init_process() {
+    lua::on_userdata = count_userdata;
+}
+auto init_state(state_config const& config) -> lua::state_owner {
+    using seconds = std::chrono::duration<double>;
+    auto const start = std::chrono::steady_clock::now();
     auto globals = std::to_array<luaL_Reg>({
         {"loadstring", loadstring},
         {"collectgarbage", collectgarbage},
+        {"print", print},
     });
-    auto state = lua::new_state({
+    auto const settings = active_build_settings();
+    // created first, the allocator counters live inside of it.
+    auto rt = new runtime{
+        .locked_out = std::make_unique<locked_stream>(*config.out),
+        .locked_err = std::make_unique<locked_stream>(*config.err),
+    };
+    rt->out = rt->locked_out.get();
+    rt->err = rt->locked_err.get();
+    auto state = lua::state_owner{lua::new_state({
+        .codegen = settings.codegen,
         .useratom = useratom,
         .globals = globals,
-    });
+        .allocator = active_allocator == allocator_kind::pool
+            ? allocator::allocate
+            : allocator::allocate_system,
+        .allocator_data = &rt->heap,
+    }).release(), close_state};
     auto L = state.get();
-    open_require(L);
-    using lua::type;
-    using namespace lib;
-    type<fs::path>::setup(L);
-    type<http::response>::setup(L);
-    type<http::client>::setup(L);
-    type<io::reader>::setup(L);
-    type<io::writer>::setup(L);
-    type<io::filereader>::setup(L);
-    type<io::filewriter>::setup(L);
+    auto const created = std::chrono::steady_clock::now();
+    rt->startup.state_seconds = seconds{created - start}.count();
+    lua::codegen::set_userdata_remapper(L, remap_userdata_type);
+    lua_callbacks(L)->userdata = rt;
+    if (active_build_profile == build_profile::coverage) coverageInit(L);
+    if (profiler::active()) profiler::attach(L);
+    if (auto const bundled = bundle::self()) bundle::open_require(L, *bundled);
+    else open_require(L);
+    // libraries and userdata metatables are materialized on first use.
     lua_newtable(L);
-    setfield<fs::library>(L, -2, "fs");
-    setfield<http::library>(L, -2, "http");
-    setfield<json::library>(L, -2, "json");
-    setfield<proc::library>(L, -2, "proc");
-    setfield<io::library>(L, -2, "io");
+    lua_createtable(L, 0, 1);
+    lua::push_cfunction(L, load_library, "wow.__index");
+    lua_setfield(L, -2, "__index");
+    lua_setreadonly(L, -1, true);
+    lua_setmetatable(L, -2);
     lua_setglobal(L, "wow");
     luaL_sandbox(L);
+    rt->startup.setup_seconds = seconds{std::chrono::steady_clock::now() - created}.count();
     return state;
 }
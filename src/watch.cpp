@@ -0,0 +1,107 @@
+#include "watch.hpp"
+#include "export.hpp"
+#include <chrono>
+#include <print>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+namespace fs = std::filesystem;
+
+namespace {
+// writes closer together than this are taken as one change.
+constexpr auto debounce = std::chrono::milliseconds{100};
+
+// a loaded file with the mtime it had when it was loaded.
+struct watched_file {
+    fs::path path;
+    fs::file_time_type mtime;
+};
+auto normalized(fs::path const& file) -> fs::path {
+    auto ec = std::error_code{};
+    return fs::absolute(file, ec).lexically_normal();
+}
+auto mtime_of(fs::path const& file) -> fs::file_time_type {
+    auto ec = std::error_code{};
+    return fs::last_write_time(file, ec);
+}
+// catches saves made while the scripts ran, before anything was watched.
+auto changed_since_loaded(std::vector<watched_file> const& files) -> fs::path {
+    for (auto const& file : files) {
+        if (mtime_of(file.path) != file.mtime) return file.path;
+    }
+    return {};
+}
+#ifdef __linux__
+// directories are watched rather than the files, editors often save by
+// renaming a new file over the old one.
+auto wait_for_change(std::vector<watched_file> const& files) -> fs::path {
+    auto const fd = ::inotify_init1(IN_CLOEXEC);
+    if (fd < 0) return {};
+    auto directories = std::unordered_map<int, fs::path>{};
+    auto watched = std::unordered_set<std::string>{};
+    for (auto const& file : files) {
+        watched.insert(file.path.string());
+        auto const dir = file.path.parent_path();
+        auto const wd = ::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+        if (wd >= 0) directories.emplace(wd, dir);
+    }
+    // checked once the watches exist, so no save falls in between.
+    auto changed = changed_since_loaded(files);
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (changed.empty()) {
+        auto const size = ::read(fd, buffer, sizeof(buffer));
+        if (size <= 0) break;
+        for (auto at = buffer; at < buffer + size;) {
+            auto const event = reinterpret_cast<inotify_event const*>(at);
+            at += sizeof(inotify_event) + event->len;
+            if (event->len == 0 or not directories.contains(event->wd)) continue;
+            auto file = directories[event->wd] / event->name;
+            if (watched.contains(file.string())) changed = std::move(file);
+        }
+    }
+    // swallow the rest of the burst.
+    auto pending = pollfd{.fd = fd, .events = POLLIN};
+    while (::poll(&pending, 1, static_cast<int>(debounce.count())) > 0) {
+        if (::read(fd, buffer, sizeof(buffer)) <= 0) break;
+    }
+    ::close(fd);
+    return changed;
+}
+#else
+auto wait_for_change(std::vector<watched_file> const& files) -> fs::path {
+    for (;;) {
+        if (auto changed = changed_since_loaded(files); not changed.empty()) {
+            std::this_thread::sleep_for(debounce);
+            return changed;
+        }
+        std::this_thread::sleep_for(debounce * 2);
+    }
+}
+#endif
+}
+void watch::run(std::span<fs::path const> scripts, std::span<std::string_view const> args) {
+    for (;;) {
+        auto files = std::vector<watched_file>{};
+        for (auto const& script : scripts) {
+            auto const path = normalized(script);
+            files.push_back({path, mtime_of(path)});
+            auto state = init_state();
+            run_script(state.get(), script, args);
+            // modules remember the mtime they were loaded with.
+            for (auto const& [module, mtime] : get_runtime(state.get()).modules) {
+                files.push_back({normalized(module), mtime});
+            }
+        }
+        std::println(stderr, "\033[2mwatching {} files\033[0m", files.size());
+        auto const changed = wait_for_change(files);
+        if (changed.empty()) return;
+        std::println(stderr, "\033[2m'{}' changed, running again\033[0m", changed.string());
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include <string_view>
+
+// wow --watch, reruns scripts when they or a module they required change.
+namespace watch {
+// runs the scripts in a fresh state, then again after every change to one
+// of the files they loaded. bytecode of unchanged files stays in the shared
+// registry, so only what changed is compiled again. runs until interrupted.
+void run(std::span<std::filesystem::path const> scripts, std::span<std::string_view const> args);
+}
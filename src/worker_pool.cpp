@@ -0,0 +1,43 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+
+worker_pool::worker_pool(unsigned threads) {
+    threads = std::max(threads, 1u);
+    threads_.reserve(threads);
+    for (unsigned i{}; i < threads; ++i) {
+        threads_.emplace_back([this] {work_loop();});
+    }
+}
+worker_pool::~worker_pool() {
+    {
+        auto lock = std::scoped_lock{mutex_};
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    threads_.clear();
+}
+void worker_pool::submit(job work) {
+    {
+        auto lock = std::scoped_lock{mutex_};
+        jobs_.push_back(std::move(work));
+    }
+    ready_.notify_one();
+}
+void worker_pool::work_loop() {
+    while (true) {
+        auto work = job{};
+        {
+            auto lock = std::unique_lock{mutex_};
+            ready_.wait(lock, [this] {return stopping_ or not jobs_.empty();});
+            // pending jobs still run on shutdown, their submitters may wait on them.
+            if (jobs_.empty()) return;
+            work = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        work();
+    }
+}
+auto worker_pool::shared() -> worker_pool& {
+    static auto pool = worker_pool{};
+    return pool;
+}
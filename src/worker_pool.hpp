@@ -0,0 +1,28 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed size pool of native threads for blocking work that must not run on
+// a VM thread. shared() is the process wide instance used by the bindings.
+class worker_pool {
+public:
+    using job = std::move_only_function<void()>;
+    explicit worker_pool(unsigned threads = std::thread::hardware_concurrency());
+    ~worker_pool();
+    worker_pool(worker_pool const&) = delete;
+    worker_pool& operator=(worker_pool const&) = delete;
+    void submit(job work);
+    auto size() const -> std::size_t {return threads_.size();}
+    static auto shared() -> worker_pool&;
+private:
+    void work_loop();
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<job> jobs_;
+    bool stopping_ = false;
+    std::vector<std::jthread> threads_;
+};